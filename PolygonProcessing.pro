@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -30,13 +30,17 @@ SOURCES += \
     polygon.cpp \
     renderarea.cpp \
     polygonclip.cpp \
-    clipdialog.cpp
+    clipdialog.cpp \
+    affine.cpp \
+    scanline.cpp
 
 HEADERS += \
         mainwindow.h \
     polygon.h \
     renderarea.h \
-    clipdialog.h
+    clipdialog.h \
+    affine.h \
+    scanline.h
 
 FORMS += \
         mainwindow.ui \
@@ -0,0 +1,160 @@
+#include "affine.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+// AVX2 is compiled per function and only used when the CPU reports it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AFFINE_AVX2
+#include <immintrin.h>
+#endif
+
+// The kernels read and write Point as two packed ints
+static_assert(sizeof(Point) == 2 * sizeof(int), "Point must be two packed ints");
+
+typedef void (*PointKernel)(const Affine2D &t, const Point *src, Point *dst, int n);
+typedef void (*DoubleKernel)(const Affine2D &t, const Point *src, double *dst, int n);
+
+// Every kernel evaluates (m11 * x + m12 * y) + dx in this order, so all of
+// them give bit-identical results.
+void mapPointsScalar(const Affine2D &t, const Point *src, Point *dst, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = t.map(src[i]);
+}
+
+void mapDoublesScalar(const Affine2D &t, const Point *src, double *dst, int n) {
+    for (int i = 0; i < n; i++) {
+        double x = src[i].x, y = src[i].y;
+        dst[2 * i] = t.m11 * x + t.m12 * y + t.dx;
+        dst[2 * i + 1] = t.m21 * x + t.m22 * y + t.dy;
+    }
+}
+
+#ifdef __SSE2__
+// Two points per register: x0 y0 x1 y1 becomes x = (x0, x1), y = (y0, y1)
+inline void mapPairSSE2(const Affine2D &t, __m128i p, __m128d &X, __m128d &Y) {
+    __m128i xy = _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 1, 2, 0));
+    __m128d x = _mm_cvtepi32_pd(xy);
+    __m128d y = _mm_cvtepi32_pd(_mm_srli_si128(xy, 8));
+    X = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(t.m11), x), _mm_mul_pd(_mm_set1_pd(t.m12), y)),
+                   _mm_set1_pd(t.dx));
+    Y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(t.m21), x), _mm_mul_pd(_mm_set1_pd(t.m22), y)),
+                   _mm_set1_pd(t.dy));
+}
+
+void mapPointsSSE2(const Affine2D &t, const Point *src, Point *dst, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i p23 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 2));
+        __m128d X01, Y01, X23, Y23;
+        mapPairSSE2(t, p01, X01, Y01);
+        mapPairSSE2(t, p23, X23, Y23);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_unpacklo_epi32(_mm_cvttpd_epi32(X01), _mm_cvttpd_epi32(Y01)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 2),
+                         _mm_unpacklo_epi32(_mm_cvttpd_epi32(X23), _mm_cvttpd_epi32(Y23)));
+    }
+    mapPointsScalar(t, src + i, dst + i, n - i);
+}
+
+void mapDoublesSSE2(const Affine2D &t, const Point *src, double *dst, int n) {
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d X, Y;
+        mapPairSSE2(t, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), X, Y);
+        _mm_storeu_pd(dst + 2 * i, _mm_unpacklo_pd(X, Y));
+        _mm_storeu_pd(dst + 2 * i + 2, _mm_unpackhi_pd(X, Y));
+    }
+    mapDoublesScalar(t, src + i, dst + 2 * i, n - i);
+}
+#endif
+
+#ifdef AFFINE_AVX2
+// Four points per register: x0 y0 ... x3 y3 becomes x = (x0..x3), y = (y0..y3)
+__attribute__((target("avx2")))
+inline void mapQuadAVX2(const Affine2D &t, const Point *src, __m256d &X, __m256d &Y) {
+    __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+    __m256i xy = _mm256_permutevar8x32_epi32(p, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+    __m256d x = _mm256_cvtepi32_pd(_mm256_castsi256_si128(xy));
+    __m256d y = _mm256_cvtepi32_pd(_mm256_extracti128_si256(xy, 1));
+    X = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(t.m11), x),
+                                    _mm256_mul_pd(_mm256_set1_pd(t.m12), y)),
+                      _mm256_set1_pd(t.dx));
+    Y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(t.m21), x),
+                                    _mm256_mul_pd(_mm256_set1_pd(t.m22), y)),
+                      _mm256_set1_pd(t.dy));
+}
+
+__attribute__((target("avx2")))
+void mapPointsAVX2(const Affine2D &t, const Point *src, Point *dst, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d X, Y;
+        mapQuadAVX2(t, src + i, X, Y);
+        __m128i x = _mm256_cvttpd_epi32(X), y = _mm256_cvttpd_epi32(Y);
+        __m256i out = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi32(x, y)),
+                                              _mm_unpackhi_epi32(x, y), 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), out);
+    }
+    mapPointsScalar(t, src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void mapDoublesAVX2(const Affine2D &t, const Point *src, double *dst, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d X, Y;
+        mapQuadAVX2(t, src + i, X, Y);
+        // x0 y0 x2 y2 and x1 y1 x3 y3, then swap the middle halves
+        __m256d lo = _mm256_unpacklo_pd(X, Y), hi = _mm256_unpackhi_pd(X, Y);
+        _mm256_storeu_pd(dst + 2 * i, _mm256_permute2f128_pd(lo, hi, 0x20));
+        _mm256_storeu_pd(dst + 2 * i + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+    }
+    mapDoublesScalar(t, src + i, dst + 2 * i, n - i);
+}
+#endif
+
+struct AffineKernels {
+    PointKernel points;
+    DoubleKernel doubles;
+    const char *name;
+};
+
+AffineKernels selectAffineKernels() {
+#ifdef AFFINE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return AffineKernels{mapPointsAVX2, mapDoublesAVX2, "avx2"};
+#endif
+#ifdef __SSE2__
+    return AffineKernels{mapPointsSSE2, mapDoublesSSE2, "sse2"};
+#else
+    return AffineKernels{mapPointsScalar, mapDoublesScalar, "scalar"};
+#endif
+}
+
+const AffineKernels &affineKernels() {
+    static const AffineKernels kernels = selectAffineKernels();
+    return kernels;
+}
+
+bool Affine2D::isIdentity() const {
+    return m11 == 1 && m12 == 0 && dx == 0 && m21 == 0 && m22 == 1 && dy == 0;
+}
+
+Point Affine2D::map(Point p) const {
+    double x = p.x, y = p.y;
+    return Point(static_cast<int>(m11 * x + m12 * y + dx),
+                 static_cast<int>(m21 * x + m22 * y + dy));
+}
+
+void Affine2D::mapPoints(const Point *src, Point *dst, int n) const {
+    affineKernels().points(*this, src, dst, n);
+}
+
+void Affine2D::mapPoints(const Point *src, double *dst, int n) const {
+    affineKernels().doubles(*this, src, dst, n);
+}
+
+const char *Affine2D::kernelName() {
+    return affineKernels().name;
+}
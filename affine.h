@@ -0,0 +1,35 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "polygon.h"
+#include <QGenericMatrix>
+
+// The top two rows of a homogeneous 3x3 transformation:
+//   x' = m11 * x + m12 * y + dx
+//   y' = m21 * x + m22 * y + dy
+class Affine2D {
+public:
+    double m11, m12, dx;
+    double m21, m22, dy;
+
+public:
+    Affine2D(): m11(1), m12(0), dx(0), m21(0), m22(1), dy(0) {}
+    Affine2D(double a11, double a12, double tx, double a21, double a22, double ty):
+        m11(a11), m12(a12), dx(tx), m21(a21), m22(a22), dy(ty) {}
+    // The bottom row of the matrix is assumed to be 0 0 1
+    explicit Affine2D(const QGenericMatrix<3, 3, double> &m):
+        m11(m(0, 0)), m12(m(0, 1)), dx(m(0, 2)), m21(m(1, 0)), m22(m(1, 1)), dy(m(1, 2)) {}
+
+    bool isIdentity() const;
+    // Coordinates are truncated towards zero, as the 3x3 multiply did
+    Point map(Point p) const;
+    // Transform n points in bulk, src and dst may be the same array. The
+    // double variant writes interleaved x, y pairs without rounding.
+    void mapPoints(const Point *src, Point *dst, int n) const;
+    void mapPoints(const Point *src, double *dst, int n) const;
+
+    // Name of the kernel mapPoints dispatches to on this CPU
+    static const char *kernelName();
+};
+
+#endif // AFFINE_H
@@ -0,0 +1,229 @@
+#include "polygon.h"
+#include "scanline.h"
+#include <QElapsedTimer>
+#include <QImage>
+#include <QtMath>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+// Usage: bench [teeth]
+// Prints the time of a few clips and of batch point location, and the heap
+// allocations of one clip and of filling a frame of layers. Allocations are
+// counted on glibc only.
+
+#ifdef __GLIBC__
+// Every heap allocation, Qt's containers included, goes through these
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+static std::atomic<long> allocations(0);
+
+extern "C" void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+    allocations++;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) {
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+long allocationCount() {
+    return allocations.load();
+}
+#else
+long allocationCount() {
+    return -1;
+}
+#endif
+
+// A thin rectangle crossed by every tooth of a comb, so one of its edges
+// carries 2 * teeth crossings
+void makeComb(int teeth, Polygon &bar, Polygon &comb) {
+    QVector<Point> r;
+    r << Point(0, 0) << Point(20 * teeth + 20, 0) << Point(20 * teeth + 20, 10) << Point(0, 10);
+    bar = Polygon(SimplePolygon(r));
+
+    QVector<Point> c;
+    c << Point(-10, -100);
+    for (int i = 0; i < teeth; i++) {
+        int x = 20 * i + 10;
+        c << Point(x, -100) << Point(x, 5) << Point(x + 10, 5) << Point(x + 10, -100);
+    }
+    c << Point(20 * teeth + 40, -100) << Point(20 * teeth + 40, -200) << Point(-10, -200);
+    comb = Polygon(SimplePolygon(c));
+}
+
+// Two wavy rings of n vertices each, offset so their boundaries cross often
+void makeCoast(int n, Polygon &a, Polygon &b) {
+    QVector<Point> p, q;
+    for (int i = 0; i < n; i++) {
+        double t = 2 * M_PI * i / n, r = 1000 + 300 * qSin(37 * t);
+        p << Point(int(2000 + r * qCos(t)), int(2000 + r * qSin(t)));
+        q << Point(int(2500 + r * qCos(t + 0.05)), int(2000 + r * qSin(t + 0.05)));
+    }
+    a = Polygon(SimplePolygon(p));
+    b = Polygon(SimplePolygon(q));
+}
+
+// A plate with a grid of side * side square holes, and a disk covering
+// most of it, so one result ring gets many holes to nest
+void makePlate(int side, Polygon &plate, Polygon &disk) {
+    QVector<Point> o;
+    o << Point(0, 0) << Point(40 * side, 0) << Point(40 * side, 40 * side) << Point(0, 40 * side);
+    plate = Polygon(SimplePolygon(o));
+    for (int i = 0; i < side; i++) {
+        for (int j = 0; j < side; j++) {
+            int x = 40 * i + 10, y = 40 * j + 10;
+            QVector<Point> h;
+            h << Point(x, y) << Point(x, y + 20) << Point(x + 20, y + 20) << Point(x + 20, y);
+            plate.addInnerRing(SimplePolygon(h));
+        }
+    }
+
+    QVector<Point> c;
+    for (int i = 0; i < 1000; i++) {
+        double t = 2 * M_PI * i / 1000;
+        c << Point(int(20 * side + 19 * side * qCos(t)), int(20 * side + 19 * side * qSin(t)));
+    }
+    disk = Polygon(SimplePolygon(c));
+}
+
+// A ring with a hole and a second ring, moved like layers being edited
+void makeLayers(QList<Polygon> &layers) {
+    QVector<Point> o, h, c;
+    for (int i = 0; i < 400; i++) {
+        double t = 2 * M_PI * i / 400;
+        o << Point(500 + int(300 * qCos(t)), 500 + int(300 * qSin(t) * (1 + 0.3 * qSin(7 * t))));
+    }
+    for (int i = 0; i < 50; i++) {
+        double t = -2 * M_PI * i / 50;
+        h << Point(500 + int(50 * qCos(t)), 500 + int(50 * qSin(t)));
+    }
+    for (int i = 0; i < 300; i++) {
+        double t = 2 * M_PI * i / 300;
+        c << Point(650 + int(250 * qCos(t) * (1 + 0.2 * qSin(5 * t))), 550 + int(250 * qSin(t)));
+    }
+
+    Polygon a(o), b(c);
+    a.addInnerRing(SimplePolygon(h));
+    a.translate(3, 4);
+    b.rotate(0.1, qSqrt(0.99));
+    for (int i = 0; i < 8; i++)
+        layers.append(i % 2 ? a : b);
+}
+
+// Locate n points of the bounding box of p through one prepared polygon,
+// in one batch and one call per point. Prints both times and the number
+// of points found inside.
+void timeLocation(const Polygon &p, int n) {
+    BoundingBox box = p.boundingBox();
+    QVector<Point> queries(n);
+    unsigned seed = 1;
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        int x = box.xmin + int((seed >> 8) % (box.xmax - box.xmin + 1));
+        seed = seed * 1103515245 + 12345;
+        int y = box.ymin + int((seed >> 8) % (box.ymax - box.ymin + 1));
+        queries[i] = Point(x, y);
+    }
+
+    PreparedPolygon prepared(p);
+    QVector<qint8> out(n);
+    QElapsedTimer timer;
+    timer.start();
+    prepared.containsBatch(queries.constData(), n, out.data());
+    double batchMs = timer.nsecsElapsed() / 1e6;
+    int inside = std::count(out.begin(), out.end(), qint8(INSIDE));
+
+    int insideLoop = 0;
+    timer.start();
+    for (int i = 0; i < n; i++) {
+        qint8 location;
+        prepared.containsBatch(&queries[i], 1, &location);
+        insideLoop += location == INSIDE;
+    }
+    double loopMs = timer.nsecsElapsed() / 1e6;
+
+    printf("locate %d points, %d vertices: batch %.2f ms, one at a time %.2f ms, %d and %d inside\n",
+           n, prepared.getVertexCount(), batchMs, loopMs, inside, insideLoop);
+}
+
+// Best of a few runs, in milliseconds
+double timeClip(const Polygon &a, const Polygon &b, int &results) {
+    double best = -1;
+    for (int run = 0; run < 5; run++) {
+        QElapsedTimer timer;
+        timer.start();
+        results = Polygon::clip(a, b).size();
+        double ms = timer.nsecsElapsed() / 1e6;
+        if (best < 0 || ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+void paintFrame(const QList<Polygon> &layers, ScanlineRasterizer &rasterizer, QImage &image) {
+    for (int i = 0; i < layers.size(); i++) {
+        Polygon p = layers[i].afterTransformation();
+        ScanlineRasterizer::fillSpans(image, rasterizer.rasterize(p), p.fillColor);
+    }
+}
+
+int main(int argc, char **argv) {
+    int teeth = argc > 1 ? atoi(argv[1]) : 5000;
+    int results;
+
+    Polygon bar, comb;
+    makeComb(teeth, bar, comb);
+    double ms = timeClip(bar, comb, results);
+    printf("clip comb, %d crossings on one edge: %.2f ms, %d polygons\n", 2 * teeth, ms, results);
+
+    Polygon a, b;
+    makeCoast(3000, a, b);
+    ms = timeClip(a, b, results);
+    printf("clip coast, 3000 vertices each: %.2f ms, %d polygons\n", ms, results);
+
+    Polygon plate, disk;
+    makePlate(30, plate, disk);
+    ms = timeClip(plate, disk, results);
+    printf("clip plate, %d holes: %.2f ms, %d polygons\n", plate.getInnerRings().size(), ms, results);
+
+    Polygon coast, unused;
+    makeCoast(5000, coast, unused);
+    timeLocation(coast, 200000);
+
+    if (allocationCount() < 0) {
+        printf("allocations are only counted on glibc\n");
+        return 0;
+    }
+
+    // The counts depend on the containers of the Qt the bench is linked with
+    printf("allocations counted with Qt %s\n", qVersion());
+
+    // Warm up first, the clip graph and the rasterizer keep their tables
+    QList<Polygon> layers;
+    makeLayers(layers);
+    Polygon::clip(layers[0], layers[1]);
+    long before = allocationCount();
+    results = Polygon::clip(layers[0], layers[1]).size();
+    printf("allocations of one clip: %ld, %d polygons\n", allocationCount() - before, results);
+
+    ScanlineRasterizer rasterizer;
+    QImage image(1000, 1000, QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+    paintFrame(layers, rasterizer, image);
+    before = allocationCount();
+    paintFrame(layers, rasterizer, image);
+    printf("allocations of filling %d layers: %ld\n", layers.size(), allocationCount() - before);
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Timing and allocation counts of the geometry code,
+# without the widgets
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+
+TARGET = bench
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        bench.cpp \
+    ../polygon.cpp \
+    ../polygonclip.cpp \
+    ../affine.cpp \
+    ../scanline.cpp
+
+HEADERS += \
+    ../polygon.h \
+    ../affine.h \
+    ../scanline.h
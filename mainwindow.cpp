@@ -52,6 +52,7 @@ void MainWindow::createRenderArea() {
     ui->horizontalLayout->setStretch(1, 4);
 
     connect(polygonRender, &RenderArea::polygonPathClosed, this, &MainWindow::restoreToolbar);
+    connect(ui->actionOutlineDrag, &QAction::toggled, polygonRender, &RenderArea::setDragOutlineOnly);
     connect(polygonRender, &RenderArea::newPolygonCreated, this, [&]() {
         QListWidgetItem *newItem = new QListWidgetItem;
         QString layerName = QString("New Layer ") + QString::number(newLayerCounter);
@@ -2,7 +2,9 @@
 #define ZOOM_MIN 0.1
 
 #include "polygon.h"
+#include "affine.h"
 #include <QtMath>
+#include <algorithm>
 
 
 // Multiplication by scalar
@@ -54,6 +56,26 @@ void Point::translate(int deltaX, int deltaY) {
     return;
 }
 
+void BoundingBox::extend(Point p) {
+    xmin = qMin(xmin, p.x);
+    ymin = qMin(ymin, p.y);
+    xmax = qMax(xmax, p.x);
+    ymax = qMax(ymax, p.y);
+}
+
+// Whether the interiors of the boxes overlap
+bool BoundingBox::overlaps(const BoundingBox &b) const {
+    return xmin < b.xmax && b.xmin < xmax && ymin < b.ymax && b.ymin < ymax;
+}
+
+bool BoundingBox::touches(const BoundingBox &b) const {
+    return xmin <= b.xmax && b.xmin <= xmax && ymin <= b.ymax && b.ymin <= ymax;
+}
+
+bool BoundingBox::contains(const BoundingBox &b) const {
+    return xmin <= b.xmin && b.xmax <= xmax && ymin <= b.ymin && b.ymax <= ymax;
+}
+
 int SimplePolygon::isClockwise() {
 
     if (vertices.size() < 3)
@@ -90,73 +112,94 @@ int SimplePolygon::isClockwise() {
 }
 
 void SimplePolygon::reverseVertices() {
-    int n = vertices.size();
-    for (int i = 0; i < n / 2; i++)
-        vertices.swap(i, n - i - 1);
+    std::reverse(vertices.begin(), vertices.end());
 }
 
-bool Polygon::isInsidePolygon(Point p) {
-    if (outerRing.vertices.size() < 3)
-        return false;
-
-    // Using ray casting method.
-
-    bool end = false;
-    bool result = false;
+bool SimplePolygon::isConvex() const {
+    if (convex != -1)
+        return convex;
 
-    auto calcIntersections = [&](QList<Point> vertices, Point p) {
-        int n = vertices.size();
+    // Every turn has to go the same way, straight on is allowed but turning
+    // back is not. A ring that winds around more than once also turns the
+    // same way everywhere, so the x direction may only change twice.
+    int n = vertices.size();
+    int turn = 0, xChanges = 0, lastDx = 0;
+    qint64 area = 0;
+    bool result = n >= 3;
+    for (int i = 0; i < n && result; i++) {
+        const Point &a = vertices[i], &b = vertices[(i + 1) % n], &c = vertices[(i + 2) % n];
+        qint64 e1x = b.x - a.x, e1y = b.y - a.y;
+        qint64 e2x = c.x - b.x, e2y = c.y - b.y;
+        qint64 cross = e1x * e2y - e1y * e2x;
+        area += static_cast<qint64>(a.x) * b.y - static_cast<qint64>(b.x) * a.y;
+
+        if ((e1x == 0 && e1y == 0) || (cross == 0 && e1x * e2x + e1y * e2y < 0))
+            result = false;
+        else if (cross != 0 && turn != 0 && (cross > 0) != (turn > 0))
+            result = false;
+        if (cross != 0)
+            turn = cross > 0 ? 1 : -1;
+
+        int dx = e1x > 0 ? 1 : (e1x < 0 ? -1 : 0);
+        if (dx != 0) {
+            if (lastDx != 0 && dx != lastDx)
+                xChanges++;
+            lastDx = dx;
+        }
+    }
+    // The change between the last and the first edge
+    if (result) {
         for (int i = 0; i < n; i++) {
-            Point A = vertices[i];
-            Point B = vertices[(i+1) % n];
-
-            // Point is right on one of the vertices.
-            if ((p.x == A.x && p.y == A.y) || (p.x == B.x && p.y == B.y)) {
-                result = false;
-                end = true;
-                return;
-            }
-            // When a vertex locates on the ray, it is counted as above the ray.
-            // If A and B in different side of a ray, we think there is an intersection.
-            if ((A.y >= p.y && B.y < p.y) || (A.y < p.y && B.y >= p.y)) {
-                double intersection_x = A.x + 1.0 * (p.y-A.y) * (A.x-B.x) / (A.y-B.y);
-
-                // Point is on one of the edges.
-                if (qAbs(intersection_x - p.x) < 0.5) {
-                    result = false;
-                    end = true;
-                    return;
-                }
-
-                if (intersection_x > p.x) {
-                    result = !result;
-                }
+            int dx = vertices[(i + 1) % n].x - vertices[i].x;
+            if (dx != 0) {
+                if ((dx > 0 ? 1 : -1) != lastDx)
+                    xChanges++;
+                break;
             }
         }
-        return;
-    };
+    }
 
-    calcIntersections(outerRing.vertices, p);
-    for (int i = 0; i < innerRings.size(); i++) {
-        if (end == true)
-            return result;
-        calcIntersections(innerRings[i].vertices, p);
+    convex = result && area != 0 && xChanges <= 2;
+    return convex;
+}
+
+double SimplePolygon::signedArea() const {
+    qint64 sum = 0;
+    int n = vertices.size();
+    for (int i = 0; i < n; i++) {
+        const Point &a = vertices[i], &b = vertices[(i + 1) % n];
+        sum += static_cast<qint64>(a.x) * b.y - static_cast<qint64>(b.x) * a.y;
     }
-    return result;
+    return sum / 2.0;
 }
 
-Point Polygon::getCenter() {
-    Polygon afterP = this->afterTransformation();
+BoundingBox SimplePolygon::boundingBox() const {
+    BoundingBox box;
+    for (int i = 0; i < vertices.size(); i++)
+        box.extend(vertices[i]);
+    return box;
+}
 
-    double meanX = 0.0, meanY = 0.0;
-    int verticesNum = afterP.outerRing.vertices.size();
-    for (int i = 0; i < verticesNum; i++) {
-        meanX += afterP.outerRing.vertices[i].x;
-        meanY += afterP.outerRing.vertices[i].y;
-    }
-    meanX /= verticesNum;
-    meanY /= verticesNum;
-    return Point(static_cast<int>(meanX), static_cast<int>(meanY));
+int SimplePolygon::pointLocation(Point p) const {
+    int n = vertices.size();
+    return locatePoint(p, n, [&](int i) {return qMakePair(vertices[i], vertices[(i + 1) % n]);});
+}
+
+void Polygon::setEdgeColor(const QColor &color) {
+    // afterTransformation takes edge colours from the rings, the cache keeps none
+    outerRing.edgeColor = color;
+    for (int i = 0; i < innerRings.size(); i++)
+        innerRings[i].edgeColor = color;
+}
+
+Point Polygon::getCenter() const {
+    updateCache();
+    return worldCenter;
+}
+
+BoundingBox Polygon::boundingBox() const {
+    updateCache();
+    return worldBoundingBox;
 }
 
 void Polygon::translate(int deltaX, int deltaY) {
@@ -166,11 +209,15 @@ void Polygon::translate(int deltaX, int deltaY) {
         0, 0, 1
     };
     transformation =  QGenericMatrix<3, 3, double>(transValue) * transformation;
+    invalidateCache();
     return;
 }
 
 void Polygon::rotate(double sinB, double cosB) {
-    Point center = getCenter();
+    rotate(sinB, cosB, getCenter());
+}
+
+void Polygon::rotate(double sinB, double cosB, Point center) {
     double transValue1[] = {
         1, 0, static_cast<double>(-center.x),
         0, 1, static_cast<double>(-center.y),
@@ -188,13 +235,14 @@ void Polygon::rotate(double sinB, double cosB) {
     };
     QGenericMatrix<3, 3, double> trans1(transValue1), trans2(transValue2), rot(rotValue);
     transformation = trans2 * rot * trans1 * transformation;
+    invalidateCache();
 
     return;
 }
 
 void Polygon::zoom(double scale) {
-    auto detTrans = [](QGenericMatrix<3, 3, double> mat){
-        double *data = mat.data();
+    auto detTrans = [](const QGenericMatrix<3, 3, double> &mat){
+        const double *data = mat.constData();
         return data[0] * data[4] - data[1] * data[3];
     };
 
@@ -229,6 +277,7 @@ void Polygon::zoom(double scale) {
 
     QGenericMatrix<3, 3, double> trans1(transValue1), trans2(transValue2), zoom(zoomValue);
     transformation = trans2 * zoom * trans1 * transformation;
+    invalidateCache();
     qDebug() << "Scale:" << detTrans(transformation);
 
     return;
@@ -254,6 +303,7 @@ void Polygon::horizontalFlip() {
     };
     QGenericMatrix<3, 3, double> trans1(transValue1), trans2(transValue2), flip(flipValue);
     transformation = trans2 * flip * trans1 * transformation;
+    invalidateCache();
 
     return;
 }
@@ -278,31 +328,64 @@ void Polygon::verticalFlip() {
     };
     QGenericMatrix<3, 3, double> trans1(transValue1), trans2(transValue2), flip(flipValue);
     transformation = trans2 * flip * trans1 * transformation;
+    invalidateCache();
 
     return;
 }
 
-SimplePolygon SimplePolygon::afterTransformation(SimplePolygon sp, QGenericMatrix<3, 3, double> transformation) {
+SimplePolygon SimplePolygon::afterTransformation(const SimplePolygon &sp, const QGenericMatrix<3, 3, double> &transformation) {
     SimplePolygon result = sp;
-    for (int i = 0; i < result.vertices.size(); i++) {
-        double values[] = {
-            static_cast<double>(result.vertices[i].x),
-            static_cast<double>(result.vertices[i].y),
-            1
-        };
-        QGenericMatrix<1, 3, double> point(values);
-        QGenericMatrix<1, 3, double> after = transformation * point;
-        result.vertices[i].x = static_cast<int>(after.data()[0]);
-        result.vertices[i].y = static_cast<int>(after.data()[1]);
-    }
+    // Rounding the vertices may break convexity, editVertices drops the cache
+    QVector<Point> &vertices = result.editVertices();
+    Affine2D(transformation).mapPoints(vertices.constData(), vertices.data(), vertices.size());
     return result;
 }
 
-Polygon Polygon::afterTransformation() {
+void Polygon::updateCache() const {
+    if (cacheValid)
+        return;
+
+    if (transformation.isIdentity()) {
+        worldOuterRing = outerRing;
+        worldInnerRings = innerRings;
+    }
+    else {
+        worldOuterRing = SimplePolygon::afterTransformation(outerRing, transformation);
+        worldInnerRings = innerRings;
+        for (int i = 0; i < worldInnerRings.size(); i++)
+            worldInnerRings[i] = SimplePolygon::afterTransformation(innerRings[i], transformation);
+    }
+
+    worldBoundingBox = worldOuterRing.boundingBox();
+
+    double meanX = 0.0, meanY = 0.0;
+    int verticesNum = worldOuterRing.getVertices().size();
+    for (int i = 0; i < verticesNum; i++) {
+        meanX += worldOuterRing.getVertices()[i].x;
+        meanY += worldOuterRing.getVertices()[i].y;
+    }
+    meanX /= verticesNum;
+    meanY /= verticesNum;
+    worldCenter = Point(static_cast<int>(meanX), static_cast<int>(meanY));
+
+    cacheValid = true;
+}
+
+bool Polygon::isConvex() const {
+    updateCache();
+    return worldOuterRing.isConvex();
+}
+
+Polygon Polygon::afterTransformation() const {
+    updateCache();
+
+    // The cached rings are shared, not copied
     Polygon result = *this;
-    result.outerRing = SimplePolygon::afterTransformation(outerRing, transformation);
+    result.outerRing = worldOuterRing;
+    result.innerRings = worldInnerRings;
+    result.outerRing.edgeColor = outerRing.edgeColor;
     for (int i = 0; i < result.innerRings.size(); i++)
-        result.innerRings[i] = SimplePolygon::afterTransformation(innerRings[i], transformation);
+        result.innerRings[i].edgeColor = innerRings[i].edgeColor;
     result.transformation.setToIdentity();
 
     return result;
@@ -2,8 +2,12 @@
 #define POLYGON_H
 
 #include <QList>
+#include <QVector>
+#include <QPair>
 #include <QColor>
 #include <QGenericMatrix>
+#include <climits>
+#include <utility>
 
 enum {
     CLOCKWISE,
@@ -26,6 +30,14 @@ enum {
     RIGHT
 };
 
+// Boolean operations of Polygon::clip, DIFFERENCE is subject minus clip
+enum ClipOperation {
+    INTERSECTION,
+    UNION,
+    DIFFERENCE,
+    XOR
+};
+
 class Vector {
 public:
     int x;
@@ -58,46 +70,227 @@ public:
     void translate(int deltaX, int deltaY);
 };
 
+// Stored inline and copied with memcpy by QVector
+Q_DECLARE_TYPEINFO(Vector, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(Point, Q_PRIMITIVE_TYPE);
+
+class BoundingBox {
+public:
+    int xmin, ymin, xmax, ymax;
+
+public:
+    BoundingBox(): xmin(INT_MAX), ymin(INT_MAX), xmax(INT_MIN), ymax(INT_MIN) {}
+    BoundingBox(int x1, int y1, int x2, int y2): xmin(x1), ymin(y1), xmax(x2), ymax(y2) {}
+
+    bool isEmpty() const {return xmin > xmax || ymin > ymax;}
+    void extend(Point p);
+    bool overlaps(const BoundingBox &b) const;
+    // Like overlaps, but boxes that only share an edge or a corner count too
+    bool touches(const BoundingBox &b) const;
+    bool contains(const BoundingBox &b) const;
+};
+
+// Exact location of p, OUTSIDE, ON_BOUNDARY or INSIDE, against the edges
+// edgeAt(0) .. edgeAt(count - 1), given as pairs of end points. They have to
+// include every edge whose y-range covers p.y. Using ray casting, a vertex
+// on the ray counts as above it.
+template <typename EdgeAt>
+int locatePoint(const Point &p, int count, EdgeAt edgeAt) {
+    bool inside = false;
+    for (int i = 0; i < count; i++) {
+        const QPair<Point, Point> edge = edgeAt(i);
+        const Point &A = edge.first, &B = edge.second;
+        qint64 cross = static_cast<qint64>(B.x - A.x) * (p.y - A.y) - static_cast<qint64>(B.y - A.y) * (p.x - A.x);
+
+        if (cross == 0 && qMin(A.x, B.x) <= p.x && p.x <= qMax(A.x, B.x) &&
+              qMin(A.y, B.y) <= p.y && p.y <= qMax(A.y, B.y))
+            return ON_BOUNDARY;
+        if ((A.y > p.y) != (B.y > p.y) && (cross > 0) == (B.y > A.y))
+            inside = !inside;
+    }
+    return inside ? INSIDE : OUTSIDE;
+}
+
 class SimplePolygon {
 public:
-    QList<Point> vertices;
     QColor edgeColor = QColor(0, 0, 0);
 
+private:
+    // Written through setVertices and editVertices, which drop the cached
+    // convexity
+    QVector<Point> vertices;
+    // Cached result of isConvex, -1 if not known yet
+    mutable int convex = -1;
+
 public:
     SimplePolygon() {}
-    SimplePolygon(QList<Point> vertices) {this->vertices = vertices;}
+    SimplePolygon(QVector<Point> vertices): vertices(std::move(vertices)) {}
+
+    const QVector<Point> &getVertices() const {return vertices;}
+    void setVertices(QVector<Point> v) {vertices = std::move(v); convex = -1;}
+    // For editing in place, the reference must not be kept
+    QVector<Point> &editVertices() {convex = -1; return vertices;}
 
     int isClockwise();
     void reverseVertices();
+    // Whether the ring is convex and not degenerate, cached until the
+    // vertices are changed
+    bool isConvex() const;
+    BoundingBox boundingBox() const;
+    // OUTSIDE, ON_BOUNDARY or INSIDE, computed exactly
+    int pointLocation(Point p) const;
+    // Shoelace area, positive if the vertices turn counterclockwise in y-up axes
+    double signedArea() const;
+
+    // Clip the ring against an axis-aligned rectangle. Concave rings may come
+    // back with edges running along the rectangle, which is harmless for filling.
+    static SimplePolygon clipToRect(const SimplePolygon &sp, const BoundingBox &rect);
 
-    static SimplePolygon afterTransformation(SimplePolygon sp, QGenericMatrix<3, 3, double> transformation);
+    static SimplePolygon afterTransformation(const SimplePolygon &sp, const QGenericMatrix<3, 3, double> &transformation);
+};
+
+class PreparedPolygon;
+
+// How often each path of Polygon::clip was taken
+struct ClipStatistics {
+    int boundingBoxesDisjoint = 0;
+    int subjectInsideClip = 0;
+    int clipInsideSubject = 0;
+    int noOverlap = 0;
+    int convex = 0;
+    int general = 0;
 };
 
 class Polygon {
 public:
-    SimplePolygon outerRing;
-    QList<SimplePolygon> innerRings;
-    QGenericMatrix<3, 3, double> transformation;
     QColor fillColor = QColor(255, 255, 255, 0);
     bool isVisible = true;
     bool isClosed = true;
 
+private:
+    // Written through setOuterRing, addInnerRing and setTransformation,
+    // which drop the cached world-space geometry
+    SimplePolygon outerRing;
+    QList<SimplePolygon> innerRings;
+    QGenericMatrix<3, 3, double> transformation;
+
+    // World-space geometry, built on demand and kept until the transformation
+    // or the rings change. Edge colours are not cached.
+    mutable bool cacheValid = false;
+    mutable SimplePolygon worldOuterRing;
+    mutable QList<SimplePolygon> worldInnerRings;
+    mutable BoundingBox worldBoundingBox;
+    mutable Point worldCenter;
+
+    void updateCache() const;
+    void invalidateCache() {cacheValid = false;}
+
 public:
     Polygon() {}
-    Polygon(SimplePolygon o, QList<SimplePolygon> i = QList<SimplePolygon>()): outerRing(o), innerRings(i) {}
-    ~Polygon() {innerRings.clear();}
+    Polygon(SimplePolygon o, QList<SimplePolygon> i = QList<SimplePolygon>()):
+        outerRing(std::move(o)), innerRings(std::move(i)) {}
+
+    const SimplePolygon &getOuterRing() const {return outerRing;}
+    const QList<SimplePolygon> &getInnerRings() const {return innerRings;}
+    void setOuterRing(SimplePolygon sp) {outerRing = std::move(sp); invalidateCache();}
+    void addInnerRing(const SimplePolygon &sp) {innerRings.append(sp); invalidateCache();}
+    // Colour of the edges of every ring
+    void setEdgeColor(const QColor &color);
+    const QGenericMatrix<3, 3, double> &getTransformation() const {return transformation;}
+    void setTransformation(const QGenericMatrix<3, 3, double> &t) {transformation = t; invalidateCache();}
 
-    bool isInsidePolygon(Point p);
-    Point getCenter();
+    Point getCenter() const;
+    // Bounding box after transformation
+    BoundingBox boundingBox() const;
+    // Whether the outer ring after transformation is convex. Kept with the
+    // cached rings, so copies made by afterTransformation carry it.
+    bool isConvex() const;
     void translate(int deltaX, int deltaY);
     void rotate(double sinB, double cosB);
+    // Rotate about a given point, saves computing the centre on every step of a drag
+    void rotate(double sinB, double cosB, Point center);
     void zoom(double scale);
     void horizontalFlip();
     void verticalFlip();
 
-    static QList<Polygon> clip(Polygon subjectP, Polygon clipP);
+    static QList<Polygon> clip(const Polygon &subjectP, const Polygon &clipP, ClipOperation operation = INTERSECTION);
+    static QList<Polygon> clip(const PreparedPolygon &subjectP, const PreparedPolygon &clipP,
+                               ClipOperation operation = INTERSECTION);
+    static QList<Polygon> clip(const Polygon &subjectP, const PreparedPolygon &clipP,
+                               ClipOperation operation = INTERSECTION);
+    static QList<Polygon> clip(const PreparedPolygon &subjectP, const Polygon &clipP,
+                               ClipOperation operation = INTERSECTION);
+    // Several operations on one pair, sharing the search for crossings.
+    // Results are returned in the order of operations.
+    static QList<QList<Polygon>> clip(const Polygon &subjectP, const Polygon &clipP,
+                                      const QVector<ClipOperation> &operations);
+    static QList<QList<Polygon>> clip(const PreparedPolygon &subjectP, const PreparedPolygon &clipP,
+                                      const QVector<ClipOperation> &operations);
+    // Clip one polygon against many, or many against one, on the global thread pool.
+    // Results are returned in the order of the list.
+    static QList<QList<Polygon>> clipMany(const Polygon &subjectP, const QList<Polygon> &clipPs);
+    static QList<QList<Polygon>> clipMany(const QList<Polygon> &subjectPs, const Polygon &clipP);
+    // Queries that need no result polygons. The area resolves touching
+    // boundaries like clip, by regarding a as moved by an infinitely small amount.
+    static double intersectionArea(const Polygon &a, const Polygon &b);
+    static double intersectionArea(const PreparedPolygon &a, const PreparedPolygon &b);
+    // The predicates take polygons as closed sets, boundaries included, and
+    // are decided exactly. Operands that only touch intersect.
+    static bool intersects(const Polygon &a, const Polygon &b);
+    static bool intersects(const PreparedPolygon &a, const PreparedPolygon &b);
+    // Whether b lies inside a, its boundary may run along the boundary of a
+    static bool contains(const Polygon &a, const Polygon &b);
+    static bool contains(const PreparedPolygon &a, const PreparedPolygon &b);
+    // Clip every ring against an axis-aligned rectangle in O(n). Meant for
+    // filling with the even-odd rule, use clip for exact geometry.
+    static Polygon clipToRect(const Polygon &p, const BoundingBox &rect);
+    static ClipStatistics clipStatistics();
+    static void resetClipStatistics();
+
+    Polygon afterTransformation() const;
+
+};
+
+// Bounding box of one edge, used by the intersection sweep of clip
+struct EdgeBox {
+    double xmin, xmax, ymin, ymax;
+    qint32 v, w; // End vertices of the edge, counted over all rings
+};
+
+// A polygon prepared as a clip operand: its rings after transformation,
+// their edges sorted for the intersection sweep and an edge table for
+// inside tests. Build it once for an operand that is clipped many times.
+class PreparedPolygon {
+    Polygon geometry;
+    QVector<EdgeBox> edges; // Sorted by xmin
+    QVector<Point> points; // Vertices of all rings, outer ring first
+    int vertexCount = 0;
+    BoundingBox boundingBox;
+
+    // Edges crossing the rows of band b are bandEdges[bandStart[b]] .. bandEdges[bandStart[b + 1] - 1]
+    int bandMinY = 0;
+    int bandHeight = 1;
+    QVector<int> bandStart;
+    QVector<QPair<Point, Point>> bandEdges;
+
+public:
+    PreparedPolygon() {}
+    explicit PreparedPolygon(const Polygon &p);
 
-    Polygon afterTransformation();
+    const Polygon &getGeometry() const {return geometry;}
+    const QVector<EdgeBox> &getEdges() const {return edges;}
+    const QVector<Point> &getPoints() const {return points;}
+    int getVertexCount() const {return vertexCount;}
+    const BoundingBox &getBoundingBox() const {return boundingBox;}
 
+    // Locate n points at once, out[i] is OUTSIDE, ON_BOUNDARY or INSIDE
+    // like SimplePolygon::pointLocation, computed exactly.
+    void containsBatch(const Point *queries, int n, qint8 *out) const;
+    // Location of the point doubled / 2, so midpoints of vertices are
+    // located exactly too
+    int locateDoubled(Point doubled) const;
+    // Inside test for p moved by direction * (e, e^2) with e infinitely small,
+    // matching the symbolic perturbation clip uses for degenerate input.
+    bool isInsidePerturbed(Point p, int direction) const;
 };
 #endif // POLYGON_H
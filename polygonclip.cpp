@@ -1,272 +1,928 @@
 #include "polygon.h"
 #include <QtMath>
+#include <QPair>
+#include <QVector>
+#include <QtConcurrent>
+#include <QAtomicInt>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 enum {
     ENTRY = true,
     EXIT = false
 };
 
-struct vertex {
-    double x, y;
-    vertex *next = nullptr, *prev = nullptr;
-    vertex *nextPoly = nullptr;
-    vertex *neighbour = nullptr;
+// Vertex flags
+enum {
+    INTERSECT = 0x1,
+    ENTRY_EXIT = 0x2,
+    PROCESSED = 0x4,
+    FROM_CLIP = 0x8
+};
+
+// Marks a missing link
+const qint32 NIL = -1;
+
+// Degenerate input (a vertex on the other polygon's edge, overlapping edges)
+// is resolved by symbolic perturbation: the subject polygon is regarded as
+// translated by (e, e^2) for an infinitely small e > 0. Every predicate
+// below is evaluated exactly on that translated input, so no vertex ever
+// lies on the other polygon's boundary, no input is modified and the same
+// input always gives the same result.
+
+#ifdef __SIZEOF_INT128__
+typedef __int128 ExactInt;
+#else
+typedef qint64 ExactInt; // Exact for coordinates within +-2^30
+#endif
+
+// Sign of (b - a) ^ (c - a) for integer coordinates, with its approximate
+// value in det. A floating point filter settles almost every call, only
+// nearly collinear points are decided in exact integer arithmetic.
+int orientation(qint64 ax, qint64 ay, qint64 bx, qint64 by, qint64 cx, qint64 cy, double &det) {
+    double detLeft = static_cast<double>(bx - ax) * static_cast<double>(cy - ay);
+    double detRight = static_cast<double>(by - ay) * static_cast<double>(cx - ax);
+    det = detLeft - detRight;
+
+    // Error bound of the floating point evaluation, see Shewchuk's orient2d
+    double errBound = 3.3306690738754716e-16 * (qAbs(detLeft) + qAbs(detRight));
+    if (det > errBound)
+        return 1;
+    if (-det > errBound)
+        return -1;
+
+    ExactInt exact = static_cast<ExactInt>(bx - ax) * (cy - ay) - static_cast<ExactInt>(by - ay) * (cx - ax);
+    return exact > 0 ? 1 : (exact < 0 ? -1 : 0);
+}
+
+// Side of c relative to the line a -> b when c is moved by direction * (e, e^2).
+// Use direction 1 for a subject vertex against a clip edge and -1 for a clip
+// vertex against a subject edge. Only a zero length edge gives 0.
+int perturbedSide(qint64 ax, qint64 ay, qint64 bx, qint64 by, qint64 cx, qint64 cy, int direction, double &det) {
+    int side = orientation(ax, ay, bx, by, cx, cy, det);
+    if (side != 0)
+        return side;
+
+    // (b - a) ^ (direction * (e, e^2)) = direction * ((bx - ax) * e^2 - (by - ay) * e)
+    if (by != ay)
+        return by > ay ? -direction : direction;
+    if (bx != ax)
+        return bx > ax ? direction : -direction;
+    return 0;
+}
+
+// Position of an intersection along its edge. The perturbed position is
+// alpha + eps1 * e + eps2 * e^2, which orders intersections that coincide
+// in the unperturbed input.
+struct AlphaKey {
     double alpha = 0;
-    bool intersect = false;
-    bool entry_exit;
-    bool processed = false;
+    double eps1 = 0, eps2 = 0;
+
+    bool operator<(const AlphaKey &k) const {
+        if (alpha != k.alpha)
+            return alpha < k.alpha;
+        if (eps1 != k.eps1)
+            return eps1 < k.eps1;
+        return eps2 < k.eps2;
+    }
 };
 
-bool intersect(vertex *P1, vertex *P2, vertex *Q1, vertex *Q2, double &alphaP, double &alphaQ) {
-    double P1P2x = P2->x - P1->x, P1P2y = P2->y - P1->y;
-    double Q1Q2x = Q2->x - Q1->x, Q1Q2y = Q2->y - Q1->y;
-    double WEC_P1 = (P1->x - Q1->x) * Q1Q2y - (P1->y - Q1->y) * Q1Q2x;
-    double WEC_P2 = (P2->x - Q1->x) * Q1Q2y - (P2->y - Q1->y) * Q1Q2x;
-    if (WEC_P1 * WEC_P2 <= 0) {
-        double WEC_Q1 = (Q1->x - P1->x) * P1P2y - (Q1->y - P1->y) * P1P2x;
-        double WEC_Q2 = (Q2->x - P1->x) * P1P2y - (Q2->y - P1->y) * P1P2x;
-        if (WEC_Q1 * WEC_Q2 <= 0) {
-            alphaP = WEC_P1 / (WEC_P1 - WEC_P2);
-            alphaQ = WEC_Q1 / (WEC_Q1 - WEC_Q2);
-
-            // perturbation for degeneracy
-            int factor = rand() % 2 ? 1 : -1;
-            if (qAbs(alphaP) < 1e-5) {
-                P1->x += 2 * factor *  Q1Q2y / qSqrt(Q1Q2x * Q1Q2x + Q1Q2y * Q1Q2y);
-                P1->y -= 2 * factor * Q1Q2x / qSqrt(Q1Q2x * Q1Q2x + Q1Q2y * Q1Q2y);
-                return intersect(P1, P2, Q1, Q2, alphaP, alphaQ);
-            } else if (qAbs(alphaP - 1) < 1e-5) {
-                P2->x += 2 * factor *  Q1Q2y / qSqrt(Q1Q2x * Q1Q2x + Q1Q2y * Q1Q2y);
-                P2->y -= 2 * factor * Q1Q2x / qSqrt(Q1Q2x * Q1Q2x + Q1Q2y * Q1Q2y);
-                return intersect(P1, P2, Q1, Q2, alphaP, alphaQ);
-            }
-            if (qAbs(alphaQ) < 1e-5) {
-                Q1->x += 2 * factor * P1P2y / qSqrt(P1P2x * P1P2x + P1P2y * P1P2y);
-                Q1->y -= 2 * factor * P1P2x / qSqrt(P1P2x * P1P2x + P1P2y * P1P2y);
-                return intersect(P1, P2, Q1, Q2, alphaP, alphaQ);
-            } else if (qAbs(alphaQ - 1) < 1e-5) {
-                Q2->x += 2 * factor * P1P2y / qSqrt(P1P2x * P1P2x + P1P2y * P1P2y);
-                Q2->y -= 2 * factor * P1P2x / qSqrt(P1P2x * P1P2x + P1P2y * P1P2y);
-                return intersect(P1, P2, Q1, Q2, alphaP, alphaQ);
-            }
+// Working graph of a clip. Vertices of both polygons live in parallel arrays
+// and refer to each other by 32-bit index, so walking a ring reads
+// contiguous memory. The arrays keep their capacity across reset(), so a
+// warmed-up clip does no per-vertex heap allocation and tearing the lists
+// down is a single reset().
+struct ClipGraph {
+    QVector<double> x, y;
+    QVector<qint32> next, prev;
+    QVector<qint32> neighbour;
+    QVector<quint8> flags;
 
-            return true;
-        }
+    // Intersections are added after the vertices of both polygons and only
+    // they have an alpha, stored at v - intersectionBase.
+    qint32 intersectionBase = 0;
+    QVector<AlphaKey> alpha;
+
+    // First vertex of every ring, outer ring first
+    QVector<qint32> subjectRings, clipRings;
+
+    void reset() {
+        x.resize(0);
+        y.resize(0);
+        next.resize(0);
+        prev.resize(0);
+        neighbour.resize(0);
+        flags.resize(0);
+        alpha.resize(0);
+        subjectRings.resize(0);
+        clipRings.resize(0);
     }
-    return false;
-}
 
-void createPolygon(vertex *&p, Polygon poly) {
+    qint32 addVertex(double vx, double vy) {
+        x.append(vx);
+        y.append(vy);
+        next.append(NIL);
+        prev.append(NIL);
+        neighbour.append(NIL);
+        flags.append(0);
+        return x.size() - 1;
+    }
 
-    vertex *head = nullptr;
+    bool isIntersect(qint32 v) const {return flags[v] & INTERSECT;}
+    bool entryExit(qint32 v) const {return flags[v] & ENTRY_EXIT;}
+    bool isProcessed(qint32 v) const {return flags[v] & PROCESSED;}
+    int operandOf(qint32 v) const {return flags[v] & FROM_CLIP ? CLIP : SUBJECT;}
+    const AlphaKey &alphaOf(qint32 v) const {return alpha[v - intersectionBase];}
 
-    if (poly.outerRing.vertices.isEmpty()) {
-        p = nullptr;
-        return;
+    void setEntryExit(qint32 v, bool status) {
+        if (status == ENTRY)
+            flags[v] |= ENTRY_EXIT;
+        else
+            flags[v] &= ~ENTRY_EXIT;
     }
 
-    auto createSimplePolygon = [](SimplePolygon sp) {
-        vertex *head = nullptr, *tail = nullptr, *prevTail = nullptr;
-        int n = sp.vertices.size();
+    void setProcessed(qint32 v) {flags[v] |= PROCESSED;}
+};
+
+bool intersect(const Point &P1, const Point &P2, const Point &Q1, const Point &Q2, AlphaKey &alphaP, AlphaKey &alphaQ) {
+    qint64 p1x = P1.x, p1y = P1.y, p2x = P2.x, p2y = P2.y;
+    qint64 q1x = Q1.x, q1y = Q1.y, q2x = Q2.x, q2y = Q2.y;
+
+    double WEC_P1, WEC_P2, WEC_Q1, WEC_Q2;
+    int sideP1 = perturbedSide(q1x, q1y, q2x, q2y, p1x, p1y, 1, WEC_P1);
+    int sideP2 = perturbedSide(q1x, q1y, q2x, q2y, p2x, p2y, 1, WEC_P2);
+    if (sideP1 == 0 || sideP1 == sideP2)
+        return false;
+
+    int sideQ1 = perturbedSide(p1x, p1y, p2x, p2y, q1x, q1y, -1, WEC_Q1);
+    int sideQ2 = perturbedSide(p1x, p1y, p2x, p2y, q2x, q2y, -1, WEC_Q2);
+    if (sideQ1 == 0 || sideQ1 == sideQ2)
+        return false;
+
+    // The perturbation shifts both ends of an edge alike, so it only moves
+    // the numerator of alpha.
+    double P1P2x = p2x - p1x, P1P2y = p2y - p1y;
+    double Q1Q2x = q2x - q1x, Q1Q2y = q2y - q1y;
+    double denomP = WEC_P1 - WEC_P2, denomQ = WEC_Q1 - WEC_Q2;
+
+    alphaP.alpha = qBound(0.0, WEC_P1 / denomP, 1.0);
+    alphaP.eps1 = -Q1Q2y / denomP;
+    alphaP.eps2 = Q1Q2x / denomP;
+
+    alphaQ.alpha = qBound(0.0, WEC_Q1 / denomQ, 1.0);
+    alphaQ.eps1 = P1P2y / denomQ;
+    alphaQ.eps2 = -P1P2x / denomQ;
+
+    return true;
+}
+
+void createPolygon(ClipGraph &g, QVector<qint32> &rings, const Polygon &poly) {
+
+    if (poly.getOuterRing().getVertices().isEmpty())
+        return;
+
+    auto createSimplePolygon = [&g](const SimplePolygon &sp) {
+        qint32 head = NIL, tail = NIL;
+        int n = sp.getVertices().size();
         for (int i = 0; i < n; i++) {
-            if (head == nullptr) {
-                head = new vertex;
-                head->x = sp.vertices[i].x;
-                head->y = sp.vertices[i].y;
-                tail = head;
+            qint32 v = g.addVertex(sp.getVertices()[i].x, sp.getVertices()[i].y);
+            if (head == NIL) {
+                head = v;
             }
             else {
-                tail->next = new vertex;
-                prevTail = tail;
-                tail = tail->next;
-                tail->x = sp.vertices[i].x;
-                tail->y = sp.vertices[i].y;
-                tail->prev = prevTail;
+                g.next[tail] = v;
+                g.prev[v] = tail;
             }
+            tail = v;
         }
-        tail->next = head;
-        head->prev = tail;
+        g.next[tail] = head;
+        g.prev[head] = tail;
         return head;
     };
 
+    rings.append(createSimplePolygon(poly.getOuterRing()));
+    for (int i=0; i<poly.getInnerRings().size(); i++) {
+        rings.append(createSimplePolygon(poly.getInnerRings()[i]));
+    }
+}
+
+qint32 createVertex(ClipGraph &g, const AlphaKey &alpha, double x, double y) {
+    qint32 v = g.addVertex(x, y);
+    g.alpha.append(alpha);
+    g.flags[v] = INTERSECT;
+
+    return v;
+}
+
+// Rounds to the nearest grid point, a computed crossing may fall just short of it
+Point getCoordinate(const ClipGraph &g, qint32 v) {
+    return Point(qRound(g.x[v]), qRound(g.y[v]));
+}
+
+// Link intersections into the rings. edgeOf[v - g.intersectionBase] is the
+// start vertex of the edge v lies on. The intersections are sorted by edge
+// and alpha once and each edge is spliced in a single pass.
+void insertIntersections(ClipGraph &g, QVector<qint32> &nodes, const QVector<qint32> &edgeOf) {
+    std::sort(nodes.begin(), nodes.end(), [&](qint32 u, qint32 v) {
+        qint32 eu = edgeOf[u - g.intersectionBase], ev = edgeOf[v - g.intersectionBase];
+        if (eu != ev)
+            return eu < ev;
+        return g.alphaOf(u) < g.alphaOf(v);
+    });
+
+    int i = 0;
+    while (i < nodes.size()) {
+        qint32 edge = edgeOf[nodes[i] - g.intersectionBase];
+        qint32 prev = edge, end = g.next[edge];
+        for (; i < nodes.size() && edgeOf[nodes[i] - g.intersectionBase] == edge; i++) {
+            g.next[prev] = nodes[i];
+            g.prev[nodes[i]] = prev;
+            prev = nodes[i];
+        }
+        g.next[prev] = end;
+        g.prev[end] = prev;
+    }
+}
+
+PreparedPolygon::PreparedPolygon(const Polygon &p) {
+    geometry = p.afterTransformation();
+    if (geometry.getOuterRing().getVertices().isEmpty())
+        return;
+
+    // Fill the cache now, prepared polygons are shared between threads
+    geometry.isConvex();
+
+    QList<const SimplePolygon*> rings;
+    rings.append(&geometry.getOuterRing());
+    for (int i = 0; i < geometry.getInnerRings().size(); i++)
+        rings.append(&geometry.getInnerRings()[i]);
 
-    head = createSimplePolygon(poly.outerRing);
+    // Vertices are numbered in the order createPolygon adds them to the graph
+    int ymin = INT_MAX, ymax = INT_MIN;
+    double sumDy = 0;
+    for (int r = 0; r < rings.size(); r++) {
+        const QVector<Point> &vertices = rings[r]->getVertices();
+        int n = vertices.size();
+        for (int i = 0; i < n; i++) {
+            const Point &v = vertices[i], &w = vertices[(i + 1) % n];
+            EdgeBox e;
+            e.xmin = qMin(v.x, w.x);
+            e.xmax = qMax(v.x, w.x);
+            e.ymin = qMin(v.y, w.y);
+            e.ymax = qMax(v.y, w.y);
+            e.v = vertexCount + i;
+            e.w = vertexCount + (i + 1) % n;
+            edges.append(e);
+            points.append(v);
+            boundingBox.extend(v);
 
-    QList<vertex*> inners;
-    for (int i=0; i<poly.innerRings.size(); i++) {
-        inners.append(createSimplePolygon(poly.innerRings[i]));
+            ymin = qMin(ymin, v.y);
+            ymax = qMax(ymax, v.y);
+            sumDy += qAbs(w.y - v.y);
+        }
+        vertexCount += n;
     }
-    if (!inners.isEmpty()) {
-        for (int i=0; i<inners.size() - 1; i++) {
-            inners[i]->nextPoly = inners[i + 1];
+
+    std::sort(edges.begin(), edges.end(), [](const EdgeBox &e1, const EdgeBox &e2) {
+        return e1.xmin < e2.xmin;
+    });
+
+    // Edge table for inside tests. The band height is chosen so that edges
+    // cover about two bands on average, which keeps the table linear in size.
+    bandMinY = ymin;
+    bandHeight = qMax(1, static_cast<int>(sumDy / (2 * vertexCount)));
+    int bandNum = (ymax - ymin) / bandHeight + 1;
+
+    bandStart.fill(0, bandNum + 1);
+    for (int r = 0; r < rings.size(); r++) {
+        const QVector<Point> &vertices = rings[r]->getVertices();
+        int n = vertices.size();
+        for (int i = 0; i < n; i++) {
+            int y1 = vertices[i].y, y2 = vertices[(i + 1) % n].y;
+            for (int b = (qMin(y1, y2) - ymin) / bandHeight; b <= (qMax(y1, y2) - ymin) / bandHeight; b++)
+                bandStart[b + 1]++;
         }
-        head->nextPoly = inners[0];
     }
+    for (int b = 0; b < bandNum; b++)
+        bandStart[b + 1] += bandStart[b];
 
-    p = head;
+    bandEdges.resize(bandStart[bandNum]);
+    QVector<int> fill = bandStart;
+    for (int r = 0; r < rings.size(); r++) {
+        const QVector<Point> &vertices = rings[r]->getVertices();
+        int n = vertices.size();
+        for (int i = 0; i < n; i++) {
+            const Point &A = vertices[i], &B = vertices[(i + 1) % n];
+            for (int b = (qMin(A.y, B.y) - ymin) / bandHeight; b <= (qMax(A.y, B.y) - ymin) / bandHeight; b++)
+                bandEdges[fill[b]++] = qMakePair(A, B);
+        }
+    }
 }
 
-vertex* createVertex(vertex *v1, vertex* v2, double alpha) {
-    vertex *v = new vertex;
-    v1->next = v;
-    v->prev = v1;
-    v->next = v2;
-    v2->prev = v;
+void PreparedPolygon::containsBatch(const Point *queries, int n, qint8 *out) const {
+    // Queries are grouped by band with a counting sort, so the edges of a
+    // band are read once for all queries falling into it
+    int bandNum = bandStart.size() - 1;
+    QVector<int> band(n, -1);
+    QVector<int> groupStart(qMax(bandNum, 0) + 1, 0);
+    for (int i = 0; i < n; i++) {
+        const Point &p = queries[i];
+        out[i] = OUTSIDE;
+        if (geometry.getOuterRing().getVertices().size() < 3 || p.x < boundingBox.xmin || p.x > boundingBox.xmax ||
+              p.y < boundingBox.ymin || p.y > boundingBox.ymax)
+            continue;
+        band[i] = (p.y - bandMinY) / bandHeight;
+        groupStart[band[i] + 1]++;
+    }
+    for (int b = 0; b < bandNum; b++)
+        groupStart[b + 1] += groupStart[b];
+    QVector<int> order(groupStart.last());
+    QVector<int> fill = groupStart;
+    for (int i = 0; i < n; i++) {
+        if (band[i] != -1)
+            order[fill[band[i]]++] = i;
+    }
 
-    v->alpha = alpha;
-    v->intersect = true;
+#ifdef __SSE2__
+    // Two queries per step in double precision, which is exact as long as
+    // coordinate differences stay below 2^25
+    bool exactInDouble = boundingBox.xmax - boundingBox.xmin < (1 << 25) &&
+            boundingBox.ymax - boundingBox.ymin < (1 << 25);
+    QVector<double> qx, qy;
+#endif
 
-    return v;
+    for (int b = 0; b < bandNum; b++) {
+        int g0 = groupStart[b], g1 = groupStart[b + 1];
+        const QPair<Point, Point> *edges = bandEdges.constData() + bandStart[b];
+        int count = bandStart[b + 1] - bandStart[b];
+
+        int g = g0;
+#ifdef __SSE2__
+        if (exactInDouble && g1 - g0 >= 2) {
+            qx.resize(0);
+            qy.resize(0);
+            for (int k = g0; k < g1; k++) {
+                qx.append(queries[order[k]].x);
+                qy.append(queries[order[k]].y);
+            }
+
+            const __m128d zero = _mm_setzero_pd();
+            for (; g + 1 < g1; g += 2) {
+                __m128d px = _mm_loadu_pd(qx.constData() + g - g0);
+                __m128d py = _mm_loadu_pd(qy.constData() + g - g0);
+                __m128d inside = zero, boundary = zero;
+
+                for (int i = 0; i < count; i++) {
+                    const Point &A = edges[i].first, &B = edges[i].second;
+                    __m128d ax = _mm_set1_pd(A.x), ay = _mm_set1_pd(A.y);
+                    __m128d by = _mm_set1_pd(B.y);
+                    __m128d cross = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(B.x - A.x), _mm_sub_pd(py, ay)),
+                                               _mm_mul_pd(_mm_set1_pd(B.y - A.y), _mm_sub_pd(px, ax)));
+
+                    // On the edge: collinear and within its bounding box
+                    __m128d within = _mm_and_pd(
+                                _mm_and_pd(_mm_cmpge_pd(px, _mm_set1_pd(qMin(A.x, B.x))),
+                                           _mm_cmple_pd(px, _mm_set1_pd(qMax(A.x, B.x)))),
+                                _mm_and_pd(_mm_cmpge_pd(py, _mm_set1_pd(qMin(A.y, B.y))),
+                                           _mm_cmple_pd(py, _mm_set1_pd(qMax(A.y, B.y)))));
+                    boundary = _mm_or_pd(boundary, _mm_and_pd(_mm_cmpeq_pd(cross, zero), within));
+
+                    // The ray to +x crosses the edge
+                    __m128d straddles = _mm_xor_pd(_mm_cmpgt_pd(ay, py), _mm_cmpgt_pd(by, py));
+                    __m128d leftOf = B.y > A.y ? _mm_cmpgt_pd(cross, zero) : _mm_cmple_pd(cross, zero);
+                    inside = _mm_xor_pd(inside, _mm_and_pd(straddles, leftOf));
+                }
+
+                int insideMask = _mm_movemask_pd(inside), boundaryMask = _mm_movemask_pd(boundary);
+                for (int lane = 0; lane < 2; lane++) {
+                    int q = order[g + lane];
+                    if (boundaryMask & (1 << lane))
+                        out[q] = ON_BOUNDARY;
+                    else
+                        out[q] = insideMask & (1 << lane) ? INSIDE : OUTSIDE;
+                }
+            }
+        }
+#endif
+        for (; g < g1; g++) {
+            int q = order[g];
+            out[q] = locatePoint(queries[q], count, [&](int i) {return edges[i];});
+        }
+    }
 }
 
-vertex getCoordinate(vertex *v) {
-    vertex result;
-    if (v->intersect) {
-        vertex *l = v, *r = v;
-        while (l->intersect) {
-            l = l->prev;
+int PreparedPolygon::locateDoubled(Point doubled) const {
+    if (geometry.getOuterRing().getVertices().size() < 3 ||
+          doubled.x < 2 * boundingBox.xmin || doubled.x > 2 * boundingBox.xmax ||
+          doubled.y < 2 * boundingBox.ymin || doubled.y > 2 * boundingBox.ymax)
+        return OUTSIDE;
+
+    // An edge reaching a half row reaches the row below it as well
+    int b = ((doubled.y >> 1) - bandMinY) / bandHeight;
+    const QPair<Point, Point> *edges = bandEdges.constData() + bandStart[b];
+    return locatePoint(doubled, bandStart[b + 1] - bandStart[b], [&](int i) {
+        return qMakePair(Point(2 * edges[i].first.x, 2 * edges[i].first.y),
+                         Point(2 * edges[i].second.x, 2 * edges[i].second.y));
+    });
+}
+
+// Call f(node) for the O(log n) nodes of a segment tree with the given
+// number of leaves that together cover the leaves lo .. hi. Stops as soon as
+// f returns true and returns whether it did.
+template <typename F>
+bool forEachCoverNode(int lo, int hi, int leaves, F f) {
+    for (int l = lo + leaves, r = hi + leaves + 1; l < r; l >>= 1, r >>= 1) {
+        if ((l & 1) && f(l++))
+            return true;
+        if ((r & 1) && f(--r))
+            return true;
+    }
+    return false;
+}
+
+// Active edges of one polygon during the sweep, looked up by y-interval.
+// Two segment trees have a leaf per distinct y of both polygons. The first
+// files an edge under the nodes covering its y-range, so the edges reaching
+// some y lie on the path from its leaf to the root. The second files it
+// under every ancestor of the leaf of its ymin, so the edges starting within
+// a y-range lie in the nodes covering that range. Every node owns a slice of
+// a flat array, sized before the sweep since every edge is inserted once.
+// Edges the sweep line has passed are dropped from a node when it is read.
+struct ActiveEdgeIndex {
+    const EdgeBox *edges = nullptr;
+    int leaves = 1;
+    QVector<int> rankMin, rankMax; // Leaves of ymin and ymax of every edge
+    QVector<int> coverStart, coverCount;
+    QVector<int> startsStart, startsCount;
+    QVector<qint32> cover, starts;
+
+    // Size the trees for edges, ys holds the distinct y of both polygons sorted
+    void prepare(const QVector<EdgeBox> &e, const QVector<double> &ys) {
+        edges = e.constData();
+        leaves = 1;
+        while (leaves < ys.size())
+            leaves *= 2;
+
+        rankMin.resize(e.size());
+        rankMax.resize(e.size());
+        coverCount.fill(0, 2 * leaves);
+        startsCount.fill(0, 2 * leaves);
+        for (int i = 0; i < e.size(); i++) {
+            rankMin[i] = std::lower_bound(ys.begin(), ys.end(), e[i].ymin) - ys.begin();
+            rankMax[i] = std::lower_bound(ys.begin(), ys.end(), e[i].ymax) - ys.begin();
+            forEachCoverNode(rankMin[i], rankMax[i], leaves, [&](int node) {
+                coverCount[node]++;
+                return false;
+            });
+            for (int node = rankMin[i] + leaves; node >= 1; node >>= 1)
+                startsCount[node]++;
         }
-        while (r->intersect) {
-            r = r->next;
+
+        coverStart.resize(2 * leaves);
+        startsStart.resize(2 * leaves);
+        int coverTotal = 0, startsTotal = 0;
+        for (int node = 0; node < 2 * leaves; node++) {
+            coverStart[node] = coverTotal;
+            coverTotal += coverCount[node];
+            coverCount[node] = 0;
+            startsStart[node] = startsTotal;
+            startsTotal += startsCount[node];
+            startsCount[node] = 0;
         }
-        result.x = (1 - v->alpha) * l->x + (v->alpha) * r->x;
-        result.y = (1 - v->alpha) * l->y + (v->alpha) * r->y;
+        cover.resize(coverTotal);
+        starts.resize(startsTotal);
     }
-    else {
-        result.x = v->x;
-        result.y = v->y;
+
+    void insert(qint32 i) {
+        forEachCoverNode(rankMin[i], rankMax[i], leaves, [&](int node) {
+            cover[coverStart[node] + coverCount[node]++] = i;
+            return false;
+        });
+        for (int node = rankMin[i] + leaves; node >= 1; node >>= 1)
+            starts[startsStart[node] + startsCount[node]++] = i;
+    }
+
+    // Report the edges filed in one node, dropping those that end left of x.
+    // With below >= 0 only edges whose ymin leaf lies below it are reported.
+    template <typename Report>
+    bool scan(QVector<qint32> &entries, int start, int &count, double x, int below, Report &report) {
+        for (int k = 0; k < count; k++) {
+            qint32 i = entries[start + k];
+            if (edges[i].xmax < x) {
+                // Leaves the sweep line for good
+                entries[start + k] = entries[start + count - 1];
+                count--;
+                k--;
+                continue;
+            }
+            if ((below < 0 || rankMin[i] < below) && report(&edges[i]))
+                return true;
+        }
+        return false;
+    }
+
+    // Report every active edge reaching x whose y-range contains the leaf y
+    template <typename Report>
+    bool stab(double x, int y, Report report) {
+        for (int node = y + leaves; node >= 1; node >>= 1) {
+            if (scan(cover, coverStart[node], coverCount[node], x, -1, report))
+                return true;
+        }
+        return false;
+    }
+
+    // Report every active edge reaching x whose y-range overlaps the leaves
+    // lo .. hi. Edges starting within them come from the second tree, those
+    // starting below lo and reaching it from the first, so none is reported
+    // twice. Returns true as soon as report does.
+    template <typename Report>
+    bool query(double x, int lo, int hi, Report report) {
+        if (forEachCoverNode(lo, hi, leaves, [&](int node) {
+                return scan(starts, startsStart[node], startsCount[node], x, -1, report);
+            }))
+            return true;
+        for (int node = lo + leaves; node >= 1; node >>= 1) {
+            if (scan(cover, coverStart[node], coverCount[node], x, lo, report))
+                return true;
+        }
+        return false;
+    }
+};
+
+// Sweep a vertical line over both edge sets sorted by xmin. Each edge is only
+// tested against the active edges of the other polygon, i.e. those whose
+// x-interval still overlaps, and visit(subjectEdge, clipEdge) is called when
+// the y-intervals overlap too. The sweep stops when visit returns true.
+// The active edges are kept in an ActiveEdgeIndex, where a query costs
+// O(log n) plus the edges it reports, and every edge is dropped once from
+// each of its O(log n) nodes. With k the number of pairs visited, the sweep
+// costs O(n log n + k) however the edges are laid out.
+template <typename Visit>
+void sweepCandidatePairs(const QVector<EdgeBox> &subjectEdges, const QVector<EdgeBox> &clipEdges, Visit visit) {
+    // Reused across calls, like the clip graph
+    static thread_local QVector<double> ys;
+    static thread_local ActiveEdgeIndex activeSubject, activeClip;
+
+    ys.resize(0);
+    for (int i = 0; i < subjectEdges.size(); i++)
+        ys << subjectEdges[i].ymin << subjectEdges[i].ymax;
+    for (int j = 0; j < clipEdges.size(); j++)
+        ys << clipEdges[j].ymin << clipEdges[j].ymax;
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    activeSubject.prepare(subjectEdges, ys);
+    activeClip.prepare(clipEdges, ys);
+
+    int i = 0, j = 0;
+    while (i < subjectEdges.size() || j < clipEdges.size()) {
+        if (j == clipEdges.size() ||
+            (i < subjectEdges.size() && subjectEdges[i].xmin <= clipEdges[j].xmin)) {
+            const EdgeBox *e = &subjectEdges[i];
+            if (activeClip.query(e->xmin, activeSubject.rankMin[i], activeSubject.rankMax[i],
+                                 [&](const EdgeBox *a) {return visit(e, a);}))
+                return;
+            activeSubject.insert(i++);
+        }
+        else {
+            const EdgeBox *e = &clipEdges[j];
+            if (activeSubject.query(e->xmin, activeClip.rankMin[j], activeClip.rankMax[j],
+                                    [&](const EdgeBox *a) {return visit(a, e);}))
+                return;
+            activeClip.insert(j++);
+        }
     }
-    return result;
 }
 
-void sortIntersection(vertex *i) {
-    while (i->next->intersect && i->next->alpha < i->alpha) {
-        // swap i and i->next
-        vertex *prev = i->prev;
-        vertex *next = i->next;
-        vertex *nn = next->next;
+bool PreparedPolygon::isInsidePerturbed(Point p, int direction) const {
+    if (geometry.getOuterRing().getVertices().size() < 3)
+        return false;
+
+    int b = p.y - bandMinY;
+    if (b < 0 || b / bandHeight >= bandStart.size() - 1)
+        return false;
+    b /= bandHeight;
 
-        prev->next = next;
-        next->prev = prev;
-        next->next = i;
-        i->prev = next;
-        i->next = nn;
-        nn->prev = i;
+    // Ray casting from p + direction * (e, e^2) towards +x. The moved point
+    // is never on an edge, so every edge is either crossed or not.
+    bool result = false;
+    for (int i = bandStart[b]; i < bandStart[b + 1]; i++) {
+        const Point &A = bandEdges[i].first, &B = bandEdges[i].second;
+        bool belowA = A.y < p.y || (A.y == p.y && direction > 0);
+        bool belowB = B.y < p.y || (B.y == p.y && direction > 0);
+        if (belowA == belowB)
+            continue;
+
+        double det;
+        int side = perturbedSide(A.x, A.y, B.x, B.y, p.x, p.y, direction, det);
+        if ((B.y > A.y) == (side > 0))
+            result = !result;
     }
+    return result;
 }
 
-void releasePoly(vertex* poly) {
-    if (poly == nullptr)
-        return;
+QAtomicInt statBoundingBoxesDisjoint, statSubjectInsideClip, statClipInsideSubject, statNoOverlap, statConvex, statGeneral;
+
+// Polygon made of the rings of p only, like the results of the general path
+Polygon bareCopy(const Polygon &p) {
+    QList<SimplePolygon> inner;
+    for (int i = 0; i < p.getInnerRings().size(); i++)
+        inner.append(SimplePolygon(p.getInnerRings()[i].getVertices()));
+    return Polygon(SimplePolygon(p.getOuterRing().getVertices()), std::move(inner));
+}
+
+// Result vertices this close are merged
+inline bool nearDuplicate(const Point &a, const Point &b) {
+    return qAbs(a.x - b.x) + qAbs(a.y - b.y) <= 2;
+}
+
+inline bool collinear(const Point &a, const Point &b, const Point &c) {
+    return static_cast<qint64>(b.x - a.x) * (c.y - b.y) == static_cast<qint64>(b.y - a.y) * (c.x - b.x);
+}
+
+// Compact a raw result ring in one pass into a reused buffer. Near duplicate
+// vertices are merged into the later one and vertices in line with their
+// neighbours are dropped, the ring is cut short at the vertex repeating its
+// start. Returns false if fewer than 3 vertices remain.
+bool compactRing(const Point *in, int n, SimplePolygon &ring) {
+    static thread_local QVector<Point> buffer;
+    if (buffer.size() < n)
+        buffer.resize(n);
+    Point *out = buffer.data();
+
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (m > 0 && nearDuplicate(out[m - 1], in[i]))
+            m--;
+        while (m >= 2 && collinear(out[m - 2], out[m - 1], in[i]))
+            m--;
+        out[m++] = in[i];
+    }
 
-    vertex *p = poly->next, *q;
-    vertex *curHead = poly;
-    while (p != nullptr) {
-        while (p != curHead) {
-            q = p->next;
-            delete p;
-            p = q;
-        }
-        curHead = p->nextPoly;
-        delete p;
-        if (curHead == nullptr)
+    // Close the ring, the end may repeat or continue its start
+    int first = 0;
+    while (m - first >= 3) {
+        if (nearDuplicate(out[m - 1], out[first]) || collinear(out[m - 2], out[m - 1], out[first]))
+            m--;
+        else if (collinear(out[m - 1], out[first], out[first + 1]))
+            first++;
+        else
             break;
+    }
+    if (m - first < 3)
+        return false;
+
+    QVector<Point> &vertices = ring.editVertices();
+    vertices.clear();
+    vertices.reserve(m - first);
+    for (int i = first; i < m; i++)
+        vertices.append(out[i]);
+    return true;
+}
 
-        p = curHead->next;
-        q = curHead;
+// Whether clipConvex can handle the operands. Convexity is cached with the
+// transformed rings of each operand.
+bool convexOperands(const Polygon &subjectP, const Polygon &clipP) {
+    return subjectP.getInnerRings().isEmpty() && clipP.getInnerRings().isEmpty() &&
+            subjectP.isConvex() && clipP.isConvex();
+}
+
+// Vertices of a ring, turned counterclockwise in the sense of orientation()
+QVector<Point> positiveRing(const SimplePolygon &sp, bool &reversed) {
+    QVector<Point> ring = sp.getVertices();
+    qint64 area = 0;
+    for (int i = 0; i < ring.size(); i++) {
+        const Point &a = ring[i], &b = ring[(i + 1) % ring.size()];
+        area += static_cast<qint64>(a.x) * b.y - static_cast<qint64>(b.x) * a.y;
     }
+    reversed = area < 0;
+    if (reversed)
+        std::reverse(ring.begin(), ring.end());
+    return ring;
+}
+
+// Whether p moved by direction * (e, e^2) lies inside the positive convex ring
+bool insideConvex(const QVector<Point> &ring, const Point &p, int direction) {
+    double det;
+    for (int i = 0; i < ring.size(); i++) {
+        const Point &a = ring[i], &b = ring[(i + 1) % ring.size()];
+        if (perturbedSide(a.x, a.y, b.x, b.y, p.x, p.y, direction, det) < 0)
+            return false;
+    }
+    return true;
+}
+
+// How the boundaries of two convex polygons relate, see walkConvex
+enum {
+    CONVEX_APART,
+    CONVEX_CROSSING,
+    CONVEX_SUBJECT_INSIDE,
+    CONVEX_CLIP_INSIDE
 };
 
-QList<Polygon> Polygon::clip(Polygon subjectP, Polygon clipP) {
-    // Using Greiner Hormann algorithm
-    Polygon afterSub = subjectP.afterTransformation();
-    Polygon afterClip = clipP.afterTransformation();
+// Intersection of two convex polygons without holes in O(n + m), after
+// O'Rourke, Chien, Olson and Naddor. Both boundaries are advanced in turn
+// so that the edge lagging behind catches up with the other one, and every
+// vertex passed while inside the other polygon is output. The predicates
+// are the perturbed ones of the general path, so touching edges and
+// vertices need no special cases.
+// P and Q are positive rings, see positiveRing. The vertices of the
+// intersection go to sink.addVertex(x, y) in the order of P, crossings with
+// their exact coordinates. Returns CONVEX_CROSSING if the sink got them,
+// otherwise how the polygons lie to each other.
+template <typename Sink>
+int walkConvex(const QVector<Point> &P, const QVector<Point> &Q, Sink &sink) {
+    int n = P.size(), m = Q.size();
 
-    if (afterSub.outerRing.vertices.size() == 0 ||
-          afterClip.outerRing.vertices.size() == 0)
-        return QList<Polygon>();
+    enum {
+        UNKNOWN,
+        P_INSIDE,
+        Q_INSIDE
+    } inside = UNKNOWN;
 
-    vertex *subject = nullptr, *clip = nullptr;
-
-    createPolygon(subject, afterSub);
-    createPolygon(clip, afterClip);
-
-    // Phase 1
-    // Find intersections and insert them into the linked list
-    vertex *s = subject, *c = clip;
-    bool sPolyEnd = false, cPolyEnd = false;
-    vertex *sCurPolyHead = s, *cCurPolyHead = c;
-    while (!sPolyEnd) {
-        // s is the first vertex
-        if (!s->intersect) {
-            // s2 is the next vertex
-            vertex *s2 = s->next;
-            while (s2->intersect) {
-                s2 = s2->next;
-            }
+    int a = 0, b = 0, advancedA = 0, advancedB = 0;
+    do {
+        const Point &P1 = P[(a + n - 1) % n], &P2 = P[a];
+        const Point &Q1 = Q[(b + m - 1) % m], &Q2 = Q[b];
 
-            while (!cPolyEnd) {
-                double a, b;
-                if (!c->intersect) {
-                    // c2 is the next vertex
-                    vertex *c2 = c->next;
-                    while (c2->intersect) {
-                        c2 = c2->next;
-                    }
-
-                    if (intersect(s, s2, c, c2, a, b)) {
-                        vertex *i1 = createVertex(s, s->next, a);
-                        vertex *i2 = createVertex(c, c->next, b);
-                        i1->neighbour = i2;
-                        i2->neighbour = i1;
-
-                        sortIntersection(i1);
-                        sortIntersection(i2);
-
-                    }
-                }
+        double det;
+        int cross = orientation(0, 0, qint64(P2.x) - P1.x, qint64(P2.y) - P1.y,
+                                qint64(Q2.x) - Q1.x, qint64(Q2.y) - Q1.y, det);
+        int pSide = perturbedSide(Q1.x, Q1.y, Q2.x, Q2.y, P2.x, P2.y, 1, det);
+        int qSide = perturbedSide(P1.x, P1.y, P2.x, P2.y, Q2.x, Q2.y, -1, det);
 
-                // Find next vertex
-                while(c->next->intersect) {
-                    c = c->next;
-                }
-                c = c->next;
-                if (c == cCurPolyHead) {
-                    c = c->nextPoly;
-                    cCurPolyHead = c;
-                }
-                if (c == nullptr)
-                    cPolyEnd = true;
-            }
+        AlphaKey alphaP, alphaQ;
+        if (intersect(P1, P2, Q1, Q2, alphaP, alphaQ)) {
+            // Count the full turn from the first crossing on
+            if (inside == UNKNOWN)
+                advancedA = advancedB = 0;
+            sink.addVertex((1 - alphaP.alpha) * P1.x + alphaP.alpha * P2.x,
+                           (1 - alphaP.alpha) * P1.y + alphaP.alpha * P2.y);
+            // At a crossing exactly one of the edges heads into the other polygon
+            inside = pSide > 0 ? P_INSIDE : Q_INSIDE;
+        }
 
-            // Find next vertex
-            while(s->next->intersect) {
-                s = s->next;
-            }
-            s = s->next;
+        // Parallel edges facing away from each other separate the polygons
+        if (cross == 0 && pSide < 0 && qSide < 0)
+            return CONVEX_APART;
 
-            if (s == sCurPolyHead) {
-                s = s->nextPoly;
-                sCurPolyHead = s;
-            }
+        bool advanceP = cross >= 0 ? qSide > 0 : pSide <= 0;
+        if (advanceP) {
+            if (inside == P_INSIDE)
+                sink.addVertex(P2.x, P2.y);
+            a = (a + 1) % n;
+            advancedA++;
+        }
+        else {
+            if (inside == Q_INSIDE)
+                sink.addVertex(Q2.x, Q2.y);
+            b = (b + 1) % m;
+            advancedB++;
+        }
+    } while ((advancedA < n || advancedB < m) && advancedA < 2 * n && advancedB < 2 * m);
+
+    if (inside != UNKNOWN)
+        return CONVEX_CROSSING;
+
+    // The boundaries do not cross, so one polygon contains the other or
+    // they do not overlap
+    if (insideConvex(Q, P[0], 1))
+        return CONVEX_SUBJECT_INSIDE;
+    if (insideConvex(P, Q[0], -1))
+        return CONVEX_CLIP_INSIDE;
+    return CONVEX_APART;
+}
+
+// Collects the vertices of walkConvex, rounded like those of the general path
+struct ConvexCollector {
+    QVector<Point> points;
 
-            // Restore c
-            c = clip;
-            cCurPolyHead = c;
-            cPolyEnd = false;
+    void addVertex(double x, double y) {points.append(Point(qRound(x), qRound(y)));}
+};
 
-            if (s == nullptr)
-                sPolyEnd = true;
+// Sums the shoelace terms of the vertices of walkConvex
+struct ConvexAreaAccumulator {
+    double area = 0;
+    double firstX = 0, firstY = 0, lastX = 0, lastY = 0;
+    bool empty = true;
+
+    void addVertex(double x, double y) {
+        if (empty) {
+            firstX = x;
+            firstY = y;
+            empty = false;
+        }
+        else {
+            area += lastX * y - x * lastY;
         }
+        lastX = x;
+        lastY = y;
+    }
+    // Area of the closed ring, positive since the rings walked are positive
+    double closedArea() const {
+        return empty ? 0 : (area + lastX * firstY - firstX * lastY) / 2;
+    }
+};
+
+QList<Polygon> clipConvex(const Polygon &afterSub, const Polygon &afterClip) {
+    bool subjectReversed, clipReversed;
+    QVector<Point> P = positiveRing(afterSub.getOuterRing(), subjectReversed);
+    QVector<Point> Q = positiveRing(afterClip.getOuterRing(), clipReversed);
+
+    ConvexCollector collector;
+    switch (walkConvex(P, Q, collector)) {
+    case CONVEX_SUBJECT_INSIDE:
+        return QList<Polygon>() << bareCopy(afterSub);
+    case CONVEX_CLIP_INSIDE:
+        return QList<Polygon>() << bareCopy(afterClip);
+    case CONVEX_APART:
+        return QList<Polygon>();
     }
 
+    // Keep the orientation of the subject like the general path does
+    QVector<Point> &raw = collector.points;
+    if (subjectReversed)
+        std::reverse(raw.begin(), raw.end());
+    SimplePolygon sp;
+    if (!compactRing(raw.constData(), raw.size(), sp))
+        return QList<Polygon>();
+    return QList<Polygon>() << Polygon(sp);
+}
+
+// One crossing of a subject edge and a clip edge
+struct Crossing {
+    qint32 s, c; // Start vertices of the edges, c counted after the subject vertices
+    AlphaKey alphaS, alphaC;
+    double x, y;
+};
+
+// Phase 1
+// Find intersections, or only the first one found if firstOnly is set.
+// Only edge pairs whose bounding boxes overlap are tested, see sweepCandidatePairs.
+QVector<Crossing> findCrossings(const PreparedPolygon &subjectOp, const PreparedPolygon &clipOp, bool firstOnly) {
+    QVector<Crossing> crossings;
+    const QVector<Point> &subjectPoints = subjectOp.getPoints(), &clipPoints = clipOp.getPoints();
+    sweepCandidatePairs(subjectOp.getEdges(), clipOp.getEdges(), [&](const EdgeBox *es, const EdgeBox *ec) {
+        const Point &s1 = subjectPoints[es->v], &s2 = subjectPoints[es->w];
+
+        Crossing k;
+        if (!intersect(s1, s2, clipPoints[ec->v], clipPoints[ec->w], k.alphaS, k.alphaC))
+            return false;
+        k.s = es->v;
+        k.c = ec->v + subjectOp.getVertexCount();
+        // Both copies of the intersection get the point on the subject edge
+        k.x = (1 - k.alphaS.alpha) * s1.x + k.alphaS.alpha * s2.x;
+        k.y = (1 - k.alphaS.alpha) * s1.y + k.alphaS.alpha * s2.y;
+        crossings.append(k);
+        return firstOnly;
+    });
+    return crossings;
+}
+
+// Each thread reuses its own graph across calls
+ClipGraph &threadGraph() {
+    static thread_local ClipGraph g;
+    return g;
+}
+
+// Build the graph of both operands with the crossings spliced in and
+// labelled as entry or exit (Phase 2)
+void buildGraph(ClipGraph &g, const PreparedPolygon &subjectOp, const PreparedPolygon &clipOp,
+                const QVector<Crossing> &crossings) {
+    g.reset();
+
+    createPolygon(g, g.subjectRings, subjectOp.getGeometry());
+    createPolygon(g, g.clipRings, clipOp.getGeometry());
+    g.intersectionBase = g.x.size();
+
+    // Insert the intersections into the linked list, spliced in per edge
+    QVector<qint32> subjectNodes, clipNodes;
+    QVector<qint32> edgeOf;
+    for (int i = 0; i < crossings.size(); i++) {
+        const Crossing &k = crossings[i];
+        qint32 i1 = createVertex(g, k.alphaS, k.x, k.y);
+        qint32 i2 = createVertex(g, k.alphaC, k.x, k.y);
+        g.flags[i2] |= FROM_CLIP;
+        g.neighbour[i1] = i2;
+        g.neighbour[i2] = i1;
+
+        subjectNodes.append(i1);
+        clipNodes.append(i2);
+        edgeOf.append(k.s);
+        edgeOf.append(k.c);
+    }
+
+    insertIntersections(g, subjectNodes, edgeOf);
+    insertIntersections(g, clipNodes, edgeOf);
+
     // Phase 2
     // Mark entry and exit of intersections
     bool status;
-    s = subject;
-    sCurPolyHead = s;
-    while (s != nullptr) {
-        if (afterClip.isInsidePolygon(Point(static_cast<int>(s->x), static_cast<int>(s->y)))) {
+    for (int r = 0; r < g.subjectRings.size(); r++) {
+        qint32 s = g.subjectRings[r];
+        if (clipOp.isInsidePerturbed(Point(static_cast<int>(g.x[s]), static_cast<int>(g.y[s])), 1)) {
             status = EXIT;
         }
         else {
@@ -274,21 +930,17 @@ QList<Polygon> Polygon::clip(Polygon subjectP, Polygon clipP) {
         }
 
         do {
-            if (s->intersect) {
-                s->entry_exit = status;
+            if (g.isIntersect(s)) {
+                g.setEntryExit(s, status);
                 status = !status;
             }
-            s = s->next;
-        } while (s != sCurPolyHead);
-
-        s = s->nextPoly;
-        sCurPolyHead = s;
+            s = g.next[s];
+        } while (s != g.subjectRings[r]);
     }
 
-    c = clip;
-    cCurPolyHead = c;
-    while (c != nullptr) {
-        if (afterSub.isInsidePolygon(Point(static_cast<int>(c->x), static_cast<int>(c->y)))) {
+    for (int r = 0; r < g.clipRings.size(); r++) {
+        qint32 c = g.clipRings[r];
+        if (subjectOp.isInsidePerturbed(Point(static_cast<int>(g.x[c]), static_cast<int>(g.y[c])), -1)) {
             status = EXIT;
         }
         else {
@@ -296,174 +948,777 @@ QList<Polygon> Polygon::clip(Polygon subjectP, Polygon clipP) {
         }
 
         do {
-            if (c->intersect) {
-                c->entry_exit = status;
+            if (g.isIntersect(c)) {
+                g.setEntryExit(c, status);
                 status = !status;
             }
-            c = c->next;
-        } while (c != cCurPolyHead);
-
-        c = c->nextPoly;
-        cCurPolyHead = c;
+            c = g.next[c];
+        } while (c != g.clipRings[r]);
     }
+}
 
-    // Phase 3
-    // Draw the intersect polygon
-    s = subject;
-    sCurPolyHead = s;
-    QList<SimplePolygon> rawResult;
-    while (s != nullptr) {
-        do {
-            s = s->next;
-            if (s->intersect && !s->processed)
+// Phase 3
+// Walk the result rings. For every ring the sink gets beginRing with the
+// subject ring it starts on and whether it starts forward along it, then
+// addVertex for each vertex passed and endRing.
+template <typename Sink>
+void walkResultRings(ClipGraph &g, bool invertSubject, bool invertClip, Sink &sink) {
+    // Another operation may have walked the graph before
+    for (int v = 0; v < g.flags.size(); v++)
+        g.flags[v] &= ~PROCESSED;
+    bool invert[] = {invertSubject, invertClip};
+
+    for (int r = 0; r < g.subjectRings.size(); r++) {
+        qint32 sCurPolyHead = g.subjectRings[r];
+        // The search for the next unprocessed intersection resumes where the
+        // last one stopped, everything before it is processed already, so
+        // each ring is scanned once however many rings start on it
+        qint32 s = sCurPolyHead;
+        while (true) {
+            do {
+                s = g.next[s];
+                if (g.isIntersect(s) && !g.isProcessed(s))
+                    break;
+            } while (s != sCurPolyHead);
+
+            if (s == sCurPolyHead)
                 break;
-        } while (s != sCurPolyHead);
 
-        if (s == sCurPolyHead) {
-            s = s->nextPoly;
-            sCurPolyHead = s;
-            continue;
+            qint32 cur = s;
+            sink.beginRing(r, g.entryExit(cur) != invertSubject);
+            sink.addVertex(cur);
+            g.setProcessed(cur);
+            if (g.neighbour[cur] != NIL)
+                g.setProcessed(g.neighbour[cur]);
+
+            do {
+                if (g.entryExit(cur) != invert[g.operandOf(cur)]) {
+                    do {
+                        cur = g.next[cur];
+                        sink.addVertex(cur);
+                        g.setProcessed(cur);
+                        if (g.neighbour[cur] != NIL)
+                            g.setProcessed(g.neighbour[cur]);
+                    } while (!g.isIntersect(cur));
+                }
+                else {
+                    do {
+                        cur = g.prev[cur];
+                        sink.addVertex(cur);
+                        g.setProcessed(cur);
+                        if (g.neighbour[cur] != NIL)
+                            g.setProcessed(g.neighbour[cur]);
+                    } while (!g.isIntersect(cur));
+                }
+                cur = g.neighbour[cur];
+            } while (cur != s);
+
+            sink.endRing();
         }
+    }
+}
 
-        vertex *cur = s;
-        SimplePolygon sp;
-        vertex cor = getCoordinate(cur);
-        sp.vertices.push_back(Point(static_cast<int>(cor.x), static_cast<int>(cor.y)));
-        cur->processed = true;
-        if (cur->neighbour)
-            cur->neighbour->processed = true;
+// Collects the walked rings one after another in a single buffer
+struct RingCollector {
+    const ClipGraph &g;
+    QVector<Point> points;
+    QVector<int> ringStart;
 
-        do {
-            if (cur->entry_exit == ENTRY) {
-                do {
-                    cur = cur->next;
-                    vertex cor = getCoordinate(cur);
-                    sp.vertices.push_back(Point(static_cast<int>(cor.x), static_cast<int>(cor.y)));
-                    cur->processed = true;
-                    if (cur->neighbour)
-                        cur->neighbour->processed = true;
-                } while (!cur->intersect);
-            }
-            else {
-                do {
-                    cur = cur->prev;
-                    vertex cor = getCoordinate(cur);
-                    sp.vertices.push_back(Point(static_cast<int>(cor.x), static_cast<int>(cor.y)));
-                    cur->processed = true;
-                    if (cur->neighbour)
-                        cur->neighbour->processed = true;
-                } while (!cur->intersect);
-            }
-            cur = cur->neighbour;
-        } while (cur != s);
+    RingCollector(const ClipGraph &graph): g(graph) {}
+    void beginRing(int, bool) {ringStart.append(points.size());}
+    void addVertex(qint32 v) {points.append(getCoordinate(g, v));}
+    void endRing() {}
+};
 
-        rawResult.push_back(sp);
+// Sums the area of the walked rings. A ring walked with the interior of the
+// result on its left is a shell if its signed area is positive and a hole
+// otherwise, so the signed areas add up without knowing the nesting.
+struct AreaAccumulator {
+    const ClipGraph &g;
+    QVector<int> interiorLeft; // Per subject ring, 1 if on the left when walked forward
+    double area = 0;
+    double ringArea = 0;
+    bool ringLeft = true;
+    qint32 first = NIL, last = NIL;
 
-        // Restore s;
-        s = sCurPolyHead;
+    AreaAccumulator(const ClipGraph &graph): g(graph) {}
+    void beginRing(int r, bool forward) {
+        ringLeft = (interiorLeft[r] == 1) == forward;
+        ringArea = 0;
+        first = last = NIL;
+    }
+    void addVertex(qint32 v) {
+        if (last == NIL)
+            first = v;
+        else
+            ringArea += g.x[last] * g.y[v] - g.x[v] * g.y[last];
+        last = v;
+    }
+    void endRing() {
+        ringArea += g.x[last] * g.y[first] - g.x[first] * g.y[last];
+        area += (ringLeft ? ringArea : -ringArea) / 2;
     }
+};
+
+// Whether a ring of the graph has no intersections
+bool ringWithoutIntersection(const ClipGraph &g, qint32 head) {
+    qint32 v = head;
+    do {
+        if (g.isIntersect(v))
+            return false;
+        v = g.next[v];
+    } while (v != head);
+    return true;
+}
 
-    // Remove duplicate vertex
-    for (int i=0; i<rawResult.size();i++) {
-        rawResult[i].vertices.takeAt(0);
+// Result of an operation on polygons whose interiors do not overlap
+QList<Polygon> disjointResult(ClipOperation operation, const Polygon &afterSub, const Polygon &afterClip) {
+    QList<Polygon> result;
+    if (operation != INTERSECTION && !afterSub.getOuterRing().getVertices().isEmpty())
+        result.append(bareCopy(afterSub));
+    if ((operation == UNION || operation == XOR) && !afterClip.getOuterRing().getVertices().isEmpty())
+        result.append(bareCopy(afterClip));
+    return result;
+}
+
+// Whether ring a lies inside ring b. Result rings do not cross, so the
+// first vertex of a off the boundary of b decides.
+bool ringInsideRing(const SimplePolygon &a, const SimplePolygon &b) {
+    for (int i = 0; i < a.getVertices().size(); i++) {
+        int location = b.pointLocation(a.getVertices()[i]);
+        if (location != ON_BOUNDARY)
+            return location == INSIDE;
+    }
+    return false;
+}
+
+// Assemble result rings into polygons. The parent of a ring is the smallest
+// ring containing it. Rings at even depth are outer rings and rings at odd
+// depth are holes of their parent, so islands inside holes come out as
+// polygons of their own. Containers are found by sweeping over the bounding
+// boxes sorted by xmin. The active boxes are kept in an ActiveEdgeIndex, so
+// a ring only meets the boxes reaching its ymin, and only rings whose box
+// contains the box of the ring are tested, smallest first.
+QList<Polygon> assembleRings(QList<SimplePolygon> rings) {
+    int n = rings.size();
+    QVector<EdgeBox> boxes(n);
+    QVector<double> areas(n);
+    QVector<int> bySweep(n);
+    QVector<double> ys;
+    for (int i = 0; i < n; i++) {
+        BoundingBox box = rings[i].boundingBox();
+        boxes[i].xmin = box.xmin;
+        boxes[i].xmax = box.xmax;
+        boxes[i].ymin = box.ymin;
+        boxes[i].ymax = box.ymax;
+        boxes[i].v = boxes[i].w = i;
+        ys << box.ymin << box.ymax;
+        areas[i] = qAbs(rings[i].signedArea());
+        bySweep[i] = i;
     }
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
 
-    // Phase 4
-    // Find those polygons with no intersection
-    s = subject;
-    sCurPolyHead = s;
-    while (s != nullptr) {
-        SimplePolygon sp;
-        bool flagNoIntersection = true;
-        do {
-            if (s->intersect) {
-                flagNoIntersection = false;
+    // A container with the same xmin enters the sweep first
+    std::sort(bySweep.begin(), bySweep.end(), [&](int a, int b) {
+        if (boxes[a].xmin != boxes[b].xmin)
+            return boxes[a].xmin < boxes[b].xmin;
+        return areas[a] > areas[b];
+    });
+
+    ActiveEdgeIndex active;
+    active.prepare(boxes, ys);
+    QVector<int> parent(n, -1);
+    QVector<int> candidates;
+    for (int k = 0; k < n; k++) {
+        int i = bySweep[k];
+        const EdgeBox &box = boxes[i];
+
+        candidates.resize(0);
+        active.stab(box.xmin, active.rankMin[i], [&](const EdgeBox *a) {
+            if (a->xmax >= box.xmax && a->ymax >= box.ymax && areas[a->v] > areas[i])
+                candidates.append(a->v);
+            return false;
+        });
+
+        std::sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+            return areas[a] < areas[b];
+        });
+        for (int c = 0; c < candidates.size(); c++) {
+            if (ringInsideRing(rings[i], rings[candidates[c]])) {
+                parent[i] = candidates[c];
                 break;
             }
-            s = s->next;
-            vertex cor = getCoordinate(s);
-            sp.vertices.push_back(Point(static_cast<int>(cor.x), static_cast<int>(cor.y)));
-        } while (s != sCurPolyHead);
+        }
+        active.insert(i);
+    }
 
-        if (flagNoIntersection && afterClip.isInsidePolygon(sp.vertices[0]))
-            rawResult.push_back(sp);
+    // Parents are larger than their children, so their depth is known first
+    QVector<int> byArea(n);
+    for (int i = 0; i < n; i++)
+        byArea[i] = i;
+    std::sort(byArea.begin(), byArea.end(), [&](int a, int b) {
+        return areas[a] > areas[b];
+    });
+    QVector<int> depth(n, 0);
+    for (int k = 0; k < n; k++) {
+        int i = byArea[k];
+        if (parent[i] != -1)
+            depth[i] = depth[parent[i]] + 1;
+    }
 
-        s = sCurPolyHead->nextPoly;
-        sCurPolyHead = s;
+    QList<Polygon> result;
+    QVector<int> polygonOf(n, -1);
+    for (int i = 0; i < n; i++) {
+        if (depth[i] % 2 == 0) {
+            polygonOf[i] = result.size();
+            result.append(Polygon(std::move(rings[i])));
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (depth[i] % 2 == 1)
+            result[polygonOf[parent[i]]].addInnerRing(rings[i]);
     }
 
-    c = clip;
-    cCurPolyHead = c;
-    while (c != nullptr) {
+    return result;
+}
+
+// Phases 3 and 4 for one operation on a labelled graph. Walking forward from
+// an entry intersection traces the intersection; inverting the labels of an
+// operand makes the walk follow its part outside the other operand instead.
+QList<Polygon> traverse(ClipGraph &g, const PreparedPolygon &subjectOp, const PreparedPolygon &clipOp,
+                        bool invertSubject, bool invertClip) {
+    // Phase 3
+    // Draw the result polygon
+    RingCollector collector(g);
+    walkResultRings(g, invertSubject, invertClip, collector);
+
+    // Compact the rings while copying them out, dropping degenerate ones
+    QList<SimplePolygon> rawResult;
+    collector.ringStart.append(collector.points.size());
+    for (int i = 0; i + 1 < collector.ringStart.size(); i++) {
         SimplePolygon sp;
-        bool flagNoIntersection = true;
+        int start = collector.ringStart[i];
+        if (compactRing(collector.points.constData() + start, collector.ringStart[i + 1] - start, sp))
+            rawResult.push_back(std::move(sp));
+    }
+
+    // Phase 4
+    // Find those polygons with no intersection. A ring is kept when it lies
+    // inside the other polygon, or outside it if its operand is inverted.
+    QVector<Point> ring;
+    for (int r = 0; r < g.subjectRings.size() + g.clipRings.size(); r++) {
+        bool isSubject = r < g.subjectRings.size();
+        qint32 head = isSubject ? g.subjectRings[r] : g.clipRings[r - g.subjectRings.size()];
+        if (!ringWithoutIntersection(g, head))
+            continue;
+
+        Point p = getCoordinate(g, head);
+        bool keep = isSubject ? clipOp.isInsidePerturbed(p, 1) != invertSubject
+                              : subjectOp.isInsidePerturbed(p, -1) != invertClip;
+        if (!keep)
+            continue;
+
+        ring.resize(0);
+        qint32 v = head;
         do {
-            if (c->intersect) {
-                flagNoIntersection = false;
-                break;
-            }
-            c = c->next;
-            vertex cor = getCoordinate(c);
-            sp.vertices.push_back(Point(static_cast<int>(cor.x), static_cast<int>(cor.y)));
-        } while (c != cCurPolyHead);
-
-        if (flagNoIntersection && afterSub.isInsidePolygon(sp.vertices[0]))
-            rawResult.push_back(sp);
-
-        c = cCurPolyHead->nextPoly;
-        cCurPolyHead = c;
-    }
-
-    // Delete redundant vertices
-    for (int i = 0; i < rawResult.size(); i++) {
-        int n = rawResult[i].vertices.size();
-        for (int j = 0; j < n; j++) {
-            Point v1 = rawResult[i].vertices[j];
-            Point v2 = rawResult[i].vertices[(j + 1) % n];
-            if (qAbs(v1.x - v2.x) + qAbs(v1.y - v2.y) <= 2.1) {
-                rawResult[i].vertices.takeAt(j);
-                j--;
-                n--;
-            }
+            ring.append(getCoordinate(g, v));
+            v = g.next[v];
+        } while (v != head);
+
+        SimplePolygon sp;
+        if (compactRing(ring.constData(), ring.size(), sp))
+            rawResult.push_back(std::move(sp));
+    }
+
+    return assembleRings(std::move(rawResult));
+}
+
+// Runs every operation in operations on the same pair of operands. The
+// crossings are found and labelled once and shared by all operations.
+QList<QList<Polygon>> clipOperands(const PreparedPolygon &subjectOp, const PreparedPolygon &clipOp,
+                                   const QVector<ClipOperation> &operations) {
+    // Using Greiner Hormann algorithm
+    const Polygon &afterSub = subjectOp.getGeometry();
+    const Polygon &afterClip = clipOp.getGeometry();
+    QList<QList<Polygon>> results;
+
+    // Polygons whose bounding boxes do not overlap cannot overlap either.
+    // Boxes that only touch are left to the perturbed path unless the
+    // intersection is all that is asked, since touching operands may merge.
+    bool intersectionOnly = operations.size() == 1 && operations[0] == INTERSECTION;
+    bool boxesApart = intersectionOnly ? !subjectOp.getBoundingBox().overlaps(clipOp.getBoundingBox())
+                                       : !subjectOp.getBoundingBox().touches(clipOp.getBoundingBox());
+    if (afterSub.getOuterRing().getVertices().size() == 0 ||
+          afterClip.getOuterRing().getVertices().size() == 0 || boxesApart) {
+        statBoundingBoxesDisjoint.fetchAndAddRelaxed(1);
+        for (int i = 0; i < operations.size(); i++)
+            results.append(disjointResult(operations[i], afterSub, afterClip));
+        return results;
+    }
+
+    if (intersectionOnly && convexOperands(afterSub, afterClip)) {
+        statConvex.fetchAndAddRelaxed(1);
+        return results << clipConvex(afterSub, afterClip);
+    }
+
+    QVector<Crossing> crossings = findCrossings(subjectOp, clipOp, false);
+
+    // Without crossings one polygon lies inside the other or they do not
+    // overlap. That is settled by a single inside test as long as the
+    // containing polygon has no holes.
+    if (intersectionOnly && crossings.isEmpty()) {
+        bool clipHasHoles = !afterClip.getInnerRings().isEmpty();
+        bool subjectHasHoles = !afterSub.getInnerRings().isEmpty();
+
+        if (!clipHasHoles && clipOp.isInsidePerturbed(subjectOp.getPoints()[0], 1)) {
+            statSubjectInsideClip.fetchAndAddRelaxed(1);
+            return results << (QList<Polygon>() << bareCopy(afterSub));
+        }
+        if (!subjectHasHoles && subjectOp.isInsidePerturbed(clipOp.getPoints()[0], -1)) {
+            statClipInsideSubject.fetchAndAddRelaxed(1);
+            return results << (QList<Polygon>() << bareCopy(afterClip));
+        }
+        if (!clipHasHoles && !subjectHasHoles) {
+            statNoOverlap.fetchAndAddRelaxed(1);
+            return results << QList<Polygon>();
+        }
+    }
+    statGeneral.fetchAndAddRelaxed(1);
+
+    ClipGraph &g = threadGraph();
+    buildGraph(g, subjectOp, clipOp, crossings);
+
+    // Phases 3 and 4 for every operation. The symmetric difference is made
+    // of both differences, which do not overlap.
+    for (int i = 0; i < operations.size(); i++) {
+        switch (operations[i]) {
+        case INTERSECTION:
+            results.append(traverse(g, subjectOp, clipOp, false, false));
+            break;
+        case UNION:
+            results.append(traverse(g, subjectOp, clipOp, true, true));
+            break;
+        case DIFFERENCE:
+            results.append(traverse(g, subjectOp, clipOp, true, false));
+            break;
+        case XOR: {
+            QList<Polygon> both = traverse(g, subjectOp, clipOp, true, false);
+            both.append(traverse(g, subjectOp, clipOp, false, true));
+            results.append(both);
+            break;
+        }
+        }
+    }
+
+    return results;
+}
+
+QList<Polygon> clipOperands(const PreparedPolygon &subjectOp, const PreparedPolygon &clipOp, ClipOperation operation) {
+    return clipOperands(subjectOp, clipOp, QVector<ClipOperation>() << operation).first();
+}
+
+QList<Polygon> Polygon::clip(const Polygon &subjectP, const Polygon &clipP, ClipOperation operation) {
+    // Convex operands need none of the prepared structures. Convexity is
+    // asked of the operands themselves, where it stays cached.
+    if (operation == INTERSECTION && convexOperands(subjectP, clipP)) {
+        if (!subjectP.boundingBox().overlaps(clipP.boundingBox())) {
+            statBoundingBoxesDisjoint.fetchAndAddRelaxed(1);
+            return QList<Polygon>();
+        }
+        statConvex.fetchAndAddRelaxed(1);
+        return clipConvex(subjectP.afterTransformation(), clipP.afterTransformation());
+    }
+    return clipOperands(PreparedPolygon(subjectP), PreparedPolygon(clipP), operation);
+}
+
+QList<Polygon> Polygon::clip(const PreparedPolygon &subjectP, const PreparedPolygon &clipP, ClipOperation operation) {
+    return clipOperands(subjectP, clipP, operation);
+}
+
+QList<Polygon> Polygon::clip(const Polygon &subjectP, const PreparedPolygon &clipP, ClipOperation operation) {
+    return clipOperands(PreparedPolygon(subjectP), clipP, operation);
+}
+
+QList<Polygon> Polygon::clip(const PreparedPolygon &subjectP, const Polygon &clipP, ClipOperation operation) {
+    return clipOperands(subjectP, PreparedPolygon(clipP), operation);
+}
+
+QList<QList<Polygon>> Polygon::clip(const Polygon &subjectP, const Polygon &clipP,
+                                    const QVector<ClipOperation> &operations) {
+    return clipOperands(PreparedPolygon(subjectP), PreparedPolygon(clipP), operations);
+}
+
+QList<QList<Polygon>> Polygon::clip(const PreparedPolygon &subjectP, const PreparedPolygon &clipP,
+                                    const QVector<ClipOperation> &operations) {
+    return clipOperands(subjectP, clipP, operations);
+}
+
+// Area of a polygon, holes subtracted
+double polygonArea(const Polygon &p) {
+    double area = qAbs(p.getOuterRing().signedArea());
+    for (int i = 0; i < p.getInnerRings().size(); i++)
+        area -= qAbs(p.getInnerRings()[i].signedArea());
+    return area;
+}
+
+// Ring r of a polygon in the order of createPolygon
+const SimplePolygon &ringOf(const Polygon &p, int r) {
+    return r == 0 ? p.getOuterRing() : p.getInnerRings()[r - 1];
+}
+
+double Polygon::intersectionArea(const PreparedPolygon &a, const PreparedPolygon &b) {
+    const Polygon &afterSub = a.getGeometry();
+    const Polygon &afterClip = b.getGeometry();
+    if (afterSub.getOuterRing().getVertices().isEmpty() || afterClip.getOuterRing().getVertices().isEmpty() ||
+          !a.getBoundingBox().overlaps(b.getBoundingBox()))
+        return 0;
+
+    // Convex operands are walked in O(n + m), summing the area on the way
+    if (convexOperands(afterSub, afterClip)) {
+        bool reversed;
+        ConvexAreaAccumulator accumulator;
+        switch (walkConvex(positiveRing(afterSub.getOuterRing(), reversed), positiveRing(afterClip.getOuterRing(), reversed),
+                           accumulator)) {
+        case CONVEX_SUBJECT_INSIDE:
+            return polygonArea(afterSub);
+        case CONVEX_CLIP_INSIDE:
+            return polygonArea(afterClip);
+        case CONVEX_APART:
+            return 0;
         }
+        return accumulator.closedArea();
     }
 
-    // Assemble raw results into polygon
-    struct flagPolygon {
-        bool isParent = true;
-        QList<int> childs;
+    QVector<Crossing> crossings = findCrossings(a, b, false);
+    if (crossings.isEmpty()) {
+        if (afterClip.getInnerRings().isEmpty() && b.isInsidePerturbed(a.getPoints()[0], 1))
+            return polygonArea(afterSub);
+        if (afterSub.getInnerRings().isEmpty() && a.isInsidePerturbed(b.getPoints()[0], -1))
+            return polygonArea(afterClip);
+        if (afterClip.getInnerRings().isEmpty() && afterSub.getInnerRings().isEmpty())
+            return 0;
+    }
+
+    ClipGraph &g = threadGraph();
+    buildGraph(g, a, b, crossings);
+
+    AreaAccumulator accumulator(g);
+    for (int r = 0; r < g.subjectRings.size(); r++) {
+        // The interior is left of an outer ring with positive area and
+        // right of such a hole
+        bool positive = ringOf(afterSub, r).signedArea() > 0;
+        accumulator.interiorLeft.append(positive == (r == 0) ? 1 : 0);
+    }
+    walkResultRings(g, false, false, accumulator);
+    double area = accumulator.area;
+
+    // Rings without intersections inside the other polygon, see traverse
+    for (int r = 0; r < g.subjectRings.size(); r++) {
+        const SimplePolygon &ring = ringOf(afterSub, r);
+        if (ringWithoutIntersection(g, g.subjectRings[r]) && b.isInsidePerturbed(ring.getVertices()[0], 1))
+            area += r == 0 ? qAbs(ring.signedArea()) : -qAbs(ring.signedArea());
+    }
+    for (int r = 0; r < g.clipRings.size(); r++) {
+        const SimplePolygon &ring = ringOf(afterClip, r);
+        if (ringWithoutIntersection(g, g.clipRings[r]) && a.isInsidePerturbed(ring.getVertices()[0], -1))
+            area += r == 0 ? qAbs(ring.signedArea()) : -qAbs(ring.signedArea());
+    }
+
+    return area;
+}
+
+double Polygon::intersectionArea(const Polygon &a, const Polygon &b) {
+    return intersectionArea(PreparedPolygon(a), PreparedPolygon(b));
+}
+
+// Whether c lies on the closed segment a b
+bool onSegment(const Point &a, const Point &b, const Point &c) {
+    double det;
+    return orientation(a.x, a.y, b.x, b.y, c.x, c.y, det) == 0 &&
+            qMin(a.x, b.x) <= c.x && c.x <= qMax(a.x, b.x) && qMin(a.y, b.y) <= c.y && c.y <= qMax(a.y, b.y);
+}
+
+// Whether the segments p1 p2 and q1 q2 cross at a single point inside both
+bool crossProperly(const Point &p1, const Point &p2, const Point &q1, const Point &q2) {
+    double det;
+    int o1 = orientation(p1.x, p1.y, p2.x, p2.y, q1.x, q1.y, det);
+    int o2 = orientation(p1.x, p1.y, p2.x, p2.y, q2.x, q2.y, det);
+    int o3 = orientation(q1.x, q1.y, q2.x, q2.y, p1.x, p1.y, det);
+    int o4 = orientation(q1.x, q1.y, q2.x, q2.y, p2.x, p2.y, det);
+    return o1 * o2 < 0 && o3 * o4 < 0;
+}
+
+// Whether the closed segments p1 p2 and q1 q2 have a point in common
+bool segmentsTouch(const Point &p1, const Point &p2, const Point &q1, const Point &q2) {
+    return crossProperly(p1, p2, q1, q2) || onSegment(p1, p2, q1) || onSegment(p1, p2, q2) ||
+            onSegment(q1, q2, p1) || onSegment(q1, q2, p2);
+}
+
+// 1 if the interior of p lies left of ring r walked forward, -1 if right,
+// in the sense of orientation()
+int interiorSide(const Polygon &p, int r) {
+    bool positive = ringOf(p, r).signedArea() > 0;
+    return positive == (r == 0) ? 1 : -1;
+}
+
+// Ring of prepared vertex v, vertices are numbered ring by ring
+int ringOfVertex(const PreparedPolygon &p, qint32 v) {
+    int r = 0;
+    for (int start = p.getGeometry().getOuterRing().getVertices().size(); v >= start; r++)
+        start += p.getGeometry().getInnerRings()[r].getVertices().size();
+    return r;
+}
+
+bool Polygon::intersects(const PreparedPolygon &a, const PreparedPolygon &b) {
+    if (a.getGeometry().getOuterRing().getVertices().isEmpty() || b.getGeometry().getOuterRing().getVertices().isEmpty() ||
+          !a.getBoundingBox().touches(b.getBoundingBox()))
+        return false;
+    const QVector<Point> &pa = a.getPoints(), &pb = b.getPoints();
+
+    // Boundaries with a point in common intersect
+    bool touch = false;
+    sweepCandidatePairs(a.getEdges(), b.getEdges(), [&](const EdgeBox *ea, const EdgeBox *eb) {
+        touch = segmentsTouch(pa[ea->v], pa[ea->w], pb[eb->v], pb[eb->w]);
+        return touch;
+    });
+    if (touch)
+        return true;
+
+    // Otherwise one has to lie inside the other, and no vertex is on a boundary
+    qint8 location;
+    b.containsBatch(&pa[0], 1, &location);
+    if (location == INSIDE)
+        return true;
+    a.containsBatch(&pb[0], 1, &location);
+    return location == INSIDE;
+}
+
+bool Polygon::intersects(const Polygon &a, const Polygon &b) {
+    return intersects(PreparedPolygon(a), PreparedPolygon(b));
+}
+
+bool Polygon::contains(const PreparedPolygon &a, const PreparedPolygon &b) {
+    if (a.getGeometry().getOuterRing().getVertices().isEmpty() || b.getGeometry().getOuterRing().getVertices().isEmpty() ||
+          !a.getBoundingBox().contains(b.getBoundingBox()))
+        return false;
+    const QVector<Point> &pa = a.getPoints(), &pb = b.getPoints();
+    const QVector<EdgeBox> &edgesB = b.getEdges();
+
+    // A boundary crossing the other one inside both edges leaves a. Every
+    // other contact is at a vertex, so the vertices of a on the edges of b
+    // split them into pieces lying each inside a, outside it or on its
+    // boundary.
+    struct Split {
+        int edge;
+        qint64 t;
+        Point p;
     };
-    int rawResultSize = rawResult.size();
-    QVector<flagPolygon> flagRaw(rawResultSize);
-    for (int i = 0; i < rawResultSize; i++) {
-        for (int j = i + 1; j < rawResultSize; j++) {
-            Polygon r1(rawResult[i]), r2(rawResult[j]);
-            if (r1.isInsidePolygon(rawResult[j].vertices[0])) {
-                flagRaw[i].childs.append(j);
-                flagRaw[j].isParent = false;
+    QVector<Split> splits;
+    bool crossing = false;
+    sweepCandidatePairs(a.getEdges(), edgesB, [&](const EdgeBox *ea, const EdgeBox *eb) {
+        const Point &A1 = pa[ea->v], &A2 = pa[ea->w];
+        const Point &B1 = pb[eb->v], &B2 = pb[eb->w];
+        if (crossProperly(A1, A2, B1, B2)) {
+            crossing = true;
+            return true;
+        }
+        const Point *ends[] = {&A1, &A2};
+        for (int k = 0; k < 2; k++) {
+            if (onSegment(B1, B2, *ends[k])) {
+                Split split;
+                split.edge = eb - edgesB.constData();
+                split.t = static_cast<qint64>(ends[k]->x - B1.x) * (B2.x - B1.x) +
+                        static_cast<qint64>(ends[k]->y - B1.y) * (B2.y - B1.y);
+                split.p = *ends[k];
+                splits.append(split);
             }
-            if (r2.isInsidePolygon(rawResult[i].vertices[0])) {
-                flagRaw[j].childs.append(i);
-                flagRaw[i].isParent = false;
+        }
+        return false;
+    });
+    if (crossing)
+        return false;
+
+    std::sort(splits.begin(), splits.end(), [](const Split &s1, const Split &s2) {
+        if (s1.edge != s2.edge)
+            return s1.edge < s2.edge;
+        return s1.t < s2.t;
+    });
+
+    // The midpoint of every piece has to lie inside a or on its boundary
+    int k = 0;
+    for (int e = 0; e < edgesB.size(); e++) {
+        Point prev = pb[edgesB[e].v];
+        for (;; k++) {
+            bool last = k == splits.size() || splits[k].edge != e;
+            Point next = last ? pb[edgesB[e].w] : splits[k].p;
+            if (next.x != prev.x || next.y != prev.y) {
+                if (a.locateDoubled(Point(prev.x + next.x, prev.y + next.y)) == OUTSIDE)
+                    return false;
+                prev = next;
             }
+            if (last)
+                break;
         }
     }
 
-    QList<Polygon> result;
-    for (int i = 0; i < rawResultSize; i++) {
-        if (flagRaw[i].isParent) {
-            SimplePolygon outer = rawResult[i];
-            QList<SimplePolygon> inner;
-            for (int j = 0; j < flagRaw[i].childs.size(); j++) {
-                inner.append(rawResult[flagRaw[i].childs[j]]);
-            }
-            Polygon p(outer, inner);
-            result.append(p);
+    // The boundary of b lies in a, so the inside of a hole of a lies either
+    // inside b or outside it. The piece of its first edge up to the first
+    // vertex of b on it tells which.
+    for (int r = 1; r <= a.getGeometry().getInnerRings().size(); r++) {
+        const QVector<Point> &hole = ringOf(a.getGeometry(), r).getVertices();
+        const Point &U = hole[0];
+        Point V = hole[1 % hole.size()];
+        for (int i = 0; i < pb.size(); i++) {
+            const Point &p = pb[i];
+            if ((p.x != U.x || p.y != U.y) && onSegment(U, V, p))
+                V = p;
+        }
+
+        Point doubled(U.x + V.x, U.y + V.y);
+        int location = b.locateDoubled(doubled);
+        if (location == INSIDE)
+            return false;
+        if (location == OUTSIDE)
+            continue;
+
+        // The piece runs along an edge of b. Compare the side the inside of
+        // b lies on with the side of the hole.
+        for (int e = 0; e < edgesB.size(); e++) {
+            const Point &P = pb[edgesB[e].v], &Q = pb[edgesB[e].w];
+            if ((P.x == Q.x && P.y == Q.y) || !onSegment(Point(2 * P.x, 2 * P.y), Point(2 * Q.x, 2 * Q.y), doubled))
+                continue;
+            double det;
+            if (orientation(P.x, P.y, Q.x, Q.y, U.x, U.y, det) != 0 || orientation(P.x, P.y, Q.x, Q.y, V.x, V.y, det) != 0)
+                continue;
+
+            bool parallel = static_cast<qint64>(V.x - U.x) * (Q.x - P.x) + static_cast<qint64>(V.y - U.y) * (Q.y - P.y) > 0;
+            int sideB = interiorSide(b.getGeometry(), ringOfVertex(b, edgesB[e].v));
+            if ((parallel ? sideB : -sideB) == -interiorSide(a.getGeometry(), r))
+                return false;
+            break;
+        }
+    }
+    return true;
+}
+
+bool Polygon::contains(const Polygon &a, const Polygon &b) {
+    return contains(PreparedPolygon(a), PreparedPolygon(b));
+}
+
+QList<QList<Polygon>> Polygon::clipMany(const Polygon &subjectP, const QList<Polygon> &clipPs) {
+    // The subject is prepared once, clip operands are prepared by the workers
+    PreparedPolygon subjectOp(subjectP);
+
+    QVector<QList<Polygon>> results(clipPs.size());
+    QList<Polygon> *out = results.data();
+    QVector<int> jobs(clipPs.size());
+    for (int i = 0; i < jobs.size(); i++)
+        jobs[i] = i;
+
+    QtConcurrent::blockingMap(jobs, [&](int i) {
+        out[i] = clipOperands(subjectOp, PreparedPolygon(clipPs[i]), INTERSECTION);
+    });
+
+    return results.toList();
+}
+
+QList<QList<Polygon>> Polygon::clipMany(const QList<Polygon> &subjectPs, const Polygon &clipP) {
+    PreparedPolygon clipOp(clipP);
+
+    QVector<QList<Polygon>> results(subjectPs.size());
+    QList<Polygon> *out = results.data();
+    QVector<int> jobs(subjectPs.size());
+    for (int i = 0; i < jobs.size(); i++)
+        jobs[i] = i;
+
+    QtConcurrent::blockingMap(jobs, [&](int i) {
+        out[i] = clipOperands(PreparedPolygon(subjectPs[i]), clipOp, INTERSECTION);
+    });
+
+    return results.toList();
+}
+
+SimplePolygon SimplePolygon::clipToRect(const SimplePolygon &sp, const BoundingBox &rect) {
+    // Using Sutherland Hodgman algorithm, one pass per side of the rectangle
+    enum {
+        SIDE_LEFT,
+        SIDE_RIGHT,
+        SIDE_TOP,
+        SIDE_BOTTOM
+    };
+
+    auto inside = [&rect](const Point &p, int side) {
+        switch (side) {
+        case SIDE_LEFT: return p.x >= rect.xmin;
+        case SIDE_RIGHT: return p.x <= rect.xmax;
+        case SIDE_TOP: return p.y >= rect.ymin;
+        default: return p.y <= rect.ymax;
         }
+    };
+    auto crossing = [&rect](const Point &a, const Point &b, int side) {
+        if (side == SIDE_LEFT || side == SIDE_RIGHT) {
+            int x = side == SIDE_LEFT ? rect.xmin : rect.xmax;
+            double t = 1.0 * (x - a.x) / (b.x - a.x);
+            return Point(x, qRound(a.y + t * (b.y - a.y)));
+        }
+        int y = side == SIDE_TOP ? rect.ymin : rect.ymax;
+        double t = 1.0 * (y - a.y) / (b.y - a.y);
+        return Point(qRound(a.x + t * (b.x - a.x)), y);
+    };
+
+    QVector<Point> in = sp.getVertices(), out;
+    for (int side = SIDE_LEFT; side <= SIDE_BOTTOM; side++) {
+        out.clear();
+        int n = in.size();
+        for (int i = 0; i < n; i++) {
+            const Point &prev = in[(i + n - 1) % n], &cur = in[i];
+            bool curInside = inside(cur, side);
+            if (curInside != inside(prev, side))
+                out.append(crossing(prev, cur, side));
+            if (curInside)
+                out.append(cur);
+        }
+        in.swap(out);
     }
 
-    releasePoly(subject);
-    releasePoly(clip);
+    SimplePolygon result(in);
+    result.edgeColor = sp.edgeColor;
+    return result;
+}
+
+Polygon Polygon::clipToRect(const Polygon &p, const BoundingBox &rect) {
+    Polygon afterP = p.afterTransformation();
+    Polygon result;
+    result.fillColor = p.fillColor;
 
+    result.setOuterRing(SimplePolygon::clipToRect(afterP.getOuterRing(), rect));
+    if (result.getOuterRing().getVertices().isEmpty())
+        return result;
+    for (int i = 0; i < afterP.getInnerRings().size(); i++) {
+        SimplePolygon inner = SimplePolygon::clipToRect(afterP.getInnerRings()[i], rect);
+        if (!inner.getVertices().isEmpty())
+            result.addInnerRing(inner);
+    }
     return result;
 }
+
+ClipStatistics Polygon::clipStatistics() {
+    ClipStatistics stats;
+    stats.boundingBoxesDisjoint = statBoundingBoxesDisjoint.loadAcquire();
+    stats.subjectInsideClip = statSubjectInsideClip.loadAcquire();
+    stats.clipInsideSubject = statClipInsideSubject.loadAcquire();
+    stats.noOverlap = statNoOverlap.loadAcquire();
+    stats.convex = statConvex.loadAcquire();
+    stats.general = statGeneral.loadAcquire();
+    return stats;
+}
+
+void Polygon::resetClipStatistics() {
+    statBoundingBoxesDisjoint.storeRelease(0);
+    statSubjectInsideClip.storeRelease(0);
+    statClipInsideSubject.storeRelease(0);
+    statNoOverlap.storeRelease(0);
+    statConvex.storeRelease(0);
+    statGeneral.storeRelease(0);
+}
@@ -5,6 +5,11 @@
 #include <QPen>
 #include <QPainter>
 #include <QMessageBox>
+#include <QtConcurrent>
+#include <QThreadPool>
+#include <cstring>
+#include <QGuiApplication>
+#include <QScreen>
 
 RenderArea::RenderArea(QWidget *parent) : QWidget (parent) {
 
@@ -14,9 +19,13 @@ RenderArea::RenderArea(QWidget *parent) : QWidget (parent) {
     qDebug() << "Render Area Width:" << areaWidth;
 
     setBackgroundRole(QPalette::Base);
-    setAutoFillBackground(true);
+    // paintEvent covers the whole widget with the canvas
+    setAttribute(Qt::WA_OpaquePaintEvent);
     setMouseTracking(true);
 
+    dragTimer.setSingleShot(true);
+    connect(&dragTimer, &QTimer::timeout, this, &RenderArea::applyDrag);
+
 }
 
 int RenderArea::getPolygonNum() {
@@ -34,23 +43,28 @@ QColor RenderArea::getPolygonEdgeColor(int id) {
     if (id < 0)
         return QColor();
 
-    return polygons[id].outerRing.edgeColor;
+    return polygons[id].getOuterRing().edgeColor;
 }
 
 void RenderArea::addPolygon() {
     polygons.append(Polygon());
+    markLayerDirty(polygons.size() - 1);
 }
 
 void RenderArea::deletePolygon(int id) {
     polygons.removeAt(id);
+    markAllLayersDirty();
 }
 
 void RenderArea::clearTempPolygonPath() {
     tempPolygonPath.clear();
+    innerRingHost = PreparedPolygon();
 }
 
 void RenderArea::setGraphLayer(int id) {
     qDebug() << "Current graph layer set to" << id;
+    if (id != curGraphLayer)
+        markAllLayersDirty();
     curGraphLayer = id;
 }
 
@@ -62,40 +76,48 @@ void RenderArea::setPolygonFillColor(int id, QColor color) {
     if (id < 0)
         return;
     polygons[id].fillColor = color;
+    markLayerDirty(id);
+    update();
 }
 
 void RenderArea::setPolygonEdgeColor(int id, QColor color) {
     if (id < 0)
         return;
-    polygons[id].outerRing.edgeColor = color;
-    for (int i = 0; i < polygons[id].innerRings.size(); i++) {
-        polygons[id].innerRings[i].edgeColor = color;
-    }
+    polygons[id].setEdgeColor(color);
+    markLayerDirty(id);
+    update();
+}
+
+void RenderArea::setDragOutlineOnly(bool on) {
+    dragOutlineOnly = on;
 }
 
 void RenderArea::eraseCurrentPolygon(){
     polygons[curGraphLayer] = Polygon();
+    markLayerDirty(curGraphLayer);
     update();
 }
 
 void RenderArea::horizontallyFlip(){
-    if (polygons[curGraphLayer].outerRing.vertices.size() == 0) {
+    if (polygons[curGraphLayer].getOuterRing().getVertices().size() == 0) {
         QMessageBox::warning(this, QString("Warning"), QString("You must have a polygon before flipping."));
         return;
     }
 
     polygons[curGraphLayer].horizontalFlip();
+    markLayerDirty(curGraphLayer);
 
     update();
 }
 
 void RenderArea::verticallyFlip() {
-    if (polygons[curGraphLayer].outerRing.vertices.size() == 0) {
+    if (polygons[curGraphLayer].getOuterRing().getVertices().size() == 0) {
         QMessageBox::warning(this, QString("Warning"), QString("You must have a polygon before flipping."));
         return;
     }
 
     polygons[curGraphLayer].verticalFlip();
+    markLayerDirty(curGraphLayer);
 
     update();
 }
@@ -104,16 +126,16 @@ void RenderArea::clip(int id1, int id2) {
     QList<Polygon> result = Polygon::clip(polygons[id1], polygons[id2]);
     polygons += result;
     for (int i = 0; i < result.size(); i++) {
+        markLayerDirty(polygons.size() - result.size() + i);
         emit newPolygonCreated();
     }
 }
 
 void RenderArea::mousePressEvent(QMouseEvent *event) {
     qDebug() << "Mouse Pressed @" << event->pos();
-    //qDebug() << "Is in the polygon:" << polygons[curGraphLayer].isInsidePolygon(curMousePos);
 
     if (curStatus == DRAW_OUTER_RING) {
-        if (polygons[curGraphLayer].outerRing.vertices.size() > 0) {
+        if (polygons[curGraphLayer].getOuterRing().getVertices().size() > 0) {
             QMessageBox::warning(this, QString("Warning"), QString("You must erase before draw a new one."));
             return;
         }
@@ -123,11 +145,12 @@ void RenderArea::mousePressEvent(QMouseEvent *event) {
         // Close the polygon path
         if (tempPolygonPath.size() >= 3 && (curMousePos - tempPolygonPath[0]).module() < 10) {
             curStatus = DEFAULT;
-            SimplePolygon sp(tempPolygonPath);
-            sp.edgeColor = polygons[curGraphLayer].outerRing.edgeColor;
-            Polygon p(sp);
+            SimplePolygon sp(std::move(tempPolygonPath));
+            sp.edgeColor = polygons[curGraphLayer].getOuterRing().edgeColor;
+            Polygon p(std::move(sp));
             p.fillColor = polygons[curGraphLayer].fillColor;
-            polygons[curGraphLayer] = Polygon(sp);
+            polygons[curGraphLayer] = std::move(p);
+            markLayerDirty(curGraphLayer);
 
             tempPolygonPath.clear();
             emit polygonPathClosed();
@@ -138,31 +161,38 @@ void RenderArea::mousePressEvent(QMouseEvent *event) {
 
     }
     else if (curStatus == DRAW_INNER_RING) {
-        if (polygons[curGraphLayer].outerRing.vertices.size() == 0) {
+        if (polygons[curGraphLayer].getOuterRing().getVertices().size() == 0) {
             QMessageBox::warning(this, QString("Warning"), QString("You must have outer ring before drawing inner ring."));
             return;
         }
 
         curMousePos = Point(event->pos().x(), event->pos().y());
 
-        Polygon afterP = polygons[curGraphLayer].afterTransformation();
+        // Every vertex of the ring is located against the same prepared layer
+        if (tempPolygonPath.isEmpty())
+            innerRingHost = PreparedPolygon(polygons[curGraphLayer]);
+        qint8 location;
+        innerRingHost.containsBatch(&curMousePos, 1, &location);
 
-        if (!afterP.isInsidePolygon(curMousePos)) {
+        if (location != INSIDE) {
             QMessageBox::warning(this, QString("Warning"), QString("Inner ring must inside the outer ring."));
-            tempPolygonPath.clear();
+            clearTempPolygonPath();
             return;
         }
 
         // Close the polygon path
         if (tempPolygonPath.size() >= 3 && (curMousePos - tempPolygonPath[0]).module() < 10) {
             curStatus = DEFAULT;
-            SimplePolygon sp(tempPolygonPath);
-            sp.edgeColor = polygons[curGraphLayer].outerRing.edgeColor;
-            afterP.innerRings.append(sp);
+            SimplePolygon sp(std::move(tempPolygonPath));
+            sp.edgeColor = polygons[curGraphLayer].getOuterRing().edgeColor;
+            // The prepared layer already holds it after transformation
+            Polygon afterP = innerRingHost.getGeometry();
+            afterP.addInnerRing(sp);
 
-            polygons[curGraphLayer] = afterP;
+            polygons[curGraphLayer] = std::move(afterP);
+            markLayerDirty(curGraphLayer);
 
-            tempPolygonPath.clear();
+            clearTempPolygonPath();
             emit polygonPathClosed();
         }
         else {
@@ -171,23 +201,26 @@ void RenderArea::mousePressEvent(QMouseEvent *event) {
 
     }
     else if (curStatus == MOVE) {
-        if (polygons[curGraphLayer].outerRing.vertices.size() == 0) {
+        if (polygons[curGraphLayer].getOuterRing().getVertices().size() == 0) {
             QMessageBox::warning(this, QString("Warning"), QString("You must have a polygon before moving."));
             return;
         }
 
         pressMousePos = Point(event->pos().x(), event->pos().y());
-        tempPolygon = polygons[curGraphLayer];
+        pressTransformation = polygons[curGraphLayer].getTransformation();
+        startDrag();
         startMove = true;
     }
     else if (curStatus == ROTATE) {
-        if (polygons[curGraphLayer].outerRing.vertices.size() == 0) {
+        if (polygons[curGraphLayer].getOuterRing().getVertices().size() == 0) {
             QMessageBox::warning(this, QString("Warning"), QString("You must have a polygon before rotating."));
             return;
         }
 
         pressMousePos = Point(event->pos().x(), event->pos().y());
-        tempPolygon = polygons[curGraphLayer];
+        pressTransformation = polygons[curGraphLayer].getTransformation();
+        dragCenter = polygons[curGraphLayer].getCenter();
+        startDrag();
         startRotate = true;
     }
 
@@ -197,21 +230,51 @@ void RenderArea::mousePressEvent(QMouseEvent *event) {
 void RenderArea::mouseMoveEvent(QMouseEvent *event) {
     curMousePos = Point(event->pos().x(), event->pos().y());
 
+    if ((curStatus == MOVE && startMove) || (curStatus == ROTATE && startRotate)) {
+        // Transform now if a refresh has passed since the last step, else
+        // once the timer fires, with the latest position
+        if (!dragTimer.isActive()) {
+            qint64 elapsed = lastDragStep.isValid() ? lastDragStep.elapsed() : dragInterval;
+            if (elapsed >= dragInterval)
+                applyDrag();
+            else
+                dragTimer.start(static_cast<int>(dragInterval - elapsed));
+        }
+    }
+    else if (curStatus == DRAW_OUTER_RING || curStatus == DRAW_INNER_RING) {
+        // Only the path being drawn follows the mouse
+        update();
+    }
+}
+
+void RenderArea::startDrag() {
+    // One transformation step per refresh of the screen
+    QScreen *screen = QGuiApplication::primaryScreen();
+    dragInterval = screen && screen->refreshRate() > 0 ? qMax(1, qRound(1000.0 / screen->refreshRate())) : 16;
+    lastDragStep.invalidate();
+    dragTimer.stop();
+
+    // Show the outline preview from the press on, not from the first step
+    if (dragOutlineOnly)
+        markLayerDirty(curGraphLayer);
+}
+
+void RenderArea::applyDrag() {
+    lastDragStep.start();
+
     if (curStatus == MOVE && startMove) {
         int deltaX = curMousePos.x - pressMousePos.x;
         int deltaY = curMousePos.y - pressMousePos.y;
 
         // Do translation.
-        Polygon translateResult = tempPolygon;
-        translateResult.translate(deltaX, deltaY);
-        polygons[curGraphLayer] = translateResult;
+        polygons[curGraphLayer].setTransformation(pressTransformation);
+        polygons[curGraphLayer].translate(deltaX, deltaY);
+        markLayerDirty(curGraphLayer);
     }
     else if (curStatus == ROTATE && startRotate == true) {
-        Point center = tempPolygon.getCenter();
-
         // Calculate counter-clockwise rotate angle beta.
-        Vector vPress = pressMousePos - center;
-        Vector vCur = curMousePos - center;
+        Vector vPress = pressMousePos - dragCenter;
+        Vector vCur = curMousePos - dragCenter;
 
         if (vPress.module() < 1e-5 || vCur.module() < 1e-5)
             return;
@@ -220,9 +283,9 @@ void RenderArea::mouseMoveEvent(QMouseEvent *event) {
         double cosB = 1.0 * (vPress * vCur) / (vPress.module() * vCur.module());
 
         // Do rotation
-        Polygon rotateResult = tempPolygon;
-        rotateResult.rotate(sinB, cosB);
-        polygons[curGraphLayer] = rotateResult;
+        polygons[curGraphLayer].setTransformation(pressTransformation);
+        polygons[curGraphLayer].rotate(sinB, cosB, dragCenter);
+        markLayerDirty(curGraphLayer);
 
     }
 
@@ -232,10 +295,23 @@ void RenderArea::mouseMoveEvent(QMouseEvent *event) {
 void RenderArea::mouseReleaseEvent(QMouseEvent *event) {
     qDebug() << "Mouse Released @" << event->pos();
 
+    // The last position is applied even if its step was still pending
+    if (dragTimer.isActive()) {
+        dragTimer.stop();
+        applyDrag();
+    }
+
+    bool dragged = startMove || startRotate;
     if (curStatus == MOVE && startMove)
         startMove = false;
     else if (curStatus == ROTATE && startRotate)
         startRotate = false;
+
+    // Back to the filled layer after an outline preview
+    if (dragged && dragOutlineOnly) {
+        markLayerDirty(curGraphLayer);
+        update();
+    }
 }
 
 void RenderArea::wheelEvent(QWheelEvent *event) {
@@ -245,26 +321,119 @@ void RenderArea::wheelEvent(QWheelEvent *event) {
             polygons[curGraphLayer].zoom(1.05);
         else
             polygons[curGraphLayer].zoom(0.95);
+        markLayerDirty(curGraphLayer);
     }
 
     update();
 }
 
 void RenderArea::paintEvent(QPaintEvent *event) {
-    paintFrame();
+    if (canvas.size() != this->size()) {
+        canvas = QImage(this->size(), QImage::Format_ARGB32_Premultiplied);
+        belowCache = QImage(this->size(), QImage::Format_ARGB32_Premultiplied);
+        activeCache = QImage(this->size(), QImage::Format_ARGB32_Premultiplied);
+        aboveCache = QImage(this->size(), QImage::Format_ARGB32_Premultiplied);
+        splitBands();
+        markAllLayersDirty();
+    }
 
-    for (int i = 0; i < polygons.size(); i++) {
-        if (polygons[i].isVisible) {
-            paintPolygon(polygons[i]);
-        }
+    // Layers split into below, current and above. Without a current layer
+    // all of them are below.
+    int active = curGraphLayer >= 0 && curGraphLayer < polygons.size() ? curGraphLayer : -1;
+    int split = active >= 0 ? active : polygons.size();
+
+    bool recompose = belowDirty || activeDirty || aboveDirty;
+    if (belowDirty) {
+        belowCache.fill(palette().color(QPalette::Base));
+        paintFrame();
+        paintLayers(belowCache, 0, split);
+    }
+    if (activeDirty) {
+        activeCache.fill(Qt::transparent);
+        bool outlineOnly = dragOutlineOnly && (startMove || startRotate);
+        activePainted = active >= 0 && paintLayers(activeCache, active, active + 1, outlineOnly);
+    }
+    if (aboveDirty) {
+        aboveCache.fill(Qt::transparent);
+        abovePainted = paintLayers(aboveCache, split + 1, polygons.size());
     }
+    belowDirty = activeDirty = aboveDirty = false;
+
+    if (recompose) {
+        memcpy(canvas.bits(), belowCache.constBits(), canvas.bytesPerLine() * canvas.height());
+        QPainter painter(&canvas);
+        if (activePainted)
+            painter.drawImage(0, 0, activeCache);
+        if (abovePainted)
+            painter.drawImage(0, 0, aboveCache);
+    }
+
+    QPainter painter(this);
+    painter.drawImage(0, 0, canvas);
+    painter.end();
 
     if (curStatus == DRAW_OUTER_RING || curStatus == DRAW_INNER_RING)
         paintTempPolygonPath();
 }
 
+void RenderArea::markLayerDirty(int id) {
+    if (curGraphLayer < 0 || id < curGraphLayer)
+        belowDirty = true;
+    else if (id == curGraphLayer)
+        activeDirty = true;
+    else
+        aboveDirty = true;
+}
+
+void RenderArea::markAllLayersDirty() {
+    belowDirty = activeDirty = aboveDirty = true;
+}
+
+// Rasterize the visible layers first <= i < last over target, every band
+// on the thread pool, edges only if outlineOnly. Returns whether any layer
+// was painted.
+bool RenderArea::paintLayers(QImage &target, int first, int last, bool outlineOnly) {
+    paintItems.clear();
+    for (int i = first; i < last; i++) {
+        if (polygons[i].isVisible) {
+            preparePolygon(polygons[i], outlineOnly);
+        }
+    }
+    if (paintItems.isEmpty())
+        return false;
+
+    uchar *bits = target.bits();
+    int bytesPerLine = target.bytesPerLine();
+    if (bands.size() == 1)
+        paintBand(bands[0], bits, bytesPerLine);
+    else
+        QtConcurrent::blockingMap(bands, [&](Band &band) {paintBand(band, bits, bytesPerLine);});
+
+    return true;
+}
+
+void RenderArea::splitBands() {
+    // A few bands per thread keeps the threads busy when layers are uneven
+    int height = canvas.height();
+    int count = qBound(1, 2 * QThreadPool::globalInstance()->maxThreadCount(), qMax(1, height / 32));
+    int bandHeight = (height + count - 1) / count;
+
+    bands.resize(0);
+    for (int y = 0; y < height; y += bandHeight) {
+        Band band;
+        band.yBegin = y;
+        band.yEnd = qMin(y + bandHeight, height);
+        bands.append(band);
+    }
+    if (bands.isEmpty()) {
+        Band band;
+        band.yBegin = band.yEnd = 0;
+        bands.append(band);
+    }
+}
+
 void RenderArea::paintFrame() {
-    QPainter painter(this);
+    QPainter painter(&belowCache);
     QPen pen(QColor(142, 142, 142), 1, Qt::SolidLine);
     painter.setPen(pen);
 
@@ -292,177 +461,77 @@ void RenderArea::paintTempPolygonPath() {
 }
 
 
-void RenderArea::paintPolygon(Polygon p) {
-    Polygon afterP = p.afterTransformation();
-
-    int areaWidth = this->size().width();
-    int areaHeight = this->size().height();
-    QList<Point> frameVertices = {
-        Point(0, 0),
-        Point(0, areaHeight),
-        Point(areaWidth, areaHeight),
-        Point(areaWidth, 0)
-    };
-    SimplePolygon sp(frameVertices);
-    Polygon frame(sp);
-
-    QList<Polygon> windowClip = Polygon::clip(afterP, frame);
-
-    // Paint inner area
-    for (int i = 0; i < windowClip.size(); i++) {
-        windowClip[i].fillColor = afterP.fillColor;
-        fillInnerArea(windowClip[i]);
-    }
-    // Paint edges
-    paintEdges(afterP.outerRing);
-    for (int i = 0; i < afterP.innerRings.size(); i++)
-        paintEdges(afterP.innerRings[i]);
+void RenderArea::preparePolygon(const Polygon &p, bool outlineOnly) {
+    PaintItem item;
+    item.outline = p.afterTransformation();
 
-}
+    // Only the part inside the window needs filling. Polygons entirely
+    // inside it are filled as they are.
+    BoundingBox window(0, 0, canvas.width(), canvas.height());
+    BoundingBox box = item.outline.boundingBox();
 
-void RenderArea::paintEdges(SimplePolygon sp) {
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing, true);
-    QPen pen(sp.edgeColor, 2, Qt::SolidLine);
-    painter.setPen(pen);
-    int v = sp.vertices.size();
-    for (int i = 0; i < v; i++) {
-        Point v1 = sp.vertices[i];
-        Point v2 = sp.vertices[(i + 1) % v];
-        painter.drawLine(v1.x, v1.y, v2.x, v2.y);
+    // Outline previews are not filled
+    if (!outlineOnly && window.contains(box)) {
+        item.fill = item.outline;
+    }
+    else if (!outlineOnly && window.overlaps(box)) {
+        Polygon visible = Polygon::clipToRect(item.outline, window);
+        if (visible.getOuterRing().getVertices().size() >= 3)
+            item.fill = visible;
     }
 
+    // The edge pen reaches a little past the vertices
+    item.ymin = box.ymin - 2;
+    item.ymax = box.ymax + 2;
+    paintItems.append(item);
 }
 
-void RenderArea::fillInnerArea(Polygon p) {
-    QPainter painter(this);
+void RenderArea::paintBand(Band &band, uchar *bits, int bytesPerLine) {
+    if (band.yBegin >= band.yEnd)
+        return;
+
+    // The band's rows of the target, sharing its memory
+    QImage view(bits + band.yBegin * bytesPerLine, canvas.width(), band.yEnd - band.yBegin,
+                bytesPerLine, QImage::Format_ARGB32_Premultiplied);
+    QPainter painter(&view);
     painter.setRenderHint(QPainter::Antialiasing, true);
-    QPen pen(p.fillColor, 1, Qt::SolidLine);
-    painter.setPen(pen);
+    painter.translate(0, -band.yBegin);
 
-    // Using Line Sweep Algorithm
-    struct Edge {
-        double x;
-        double deltax;
-        int ymax;
-        Edge *next;
+    for (int i = 0; i < paintItems.size(); i++) {
+        const PaintItem &item = paintItems[i];
+        if (item.ymax < band.yBegin || item.ymin >= band.yEnd)
+            continue;
 
-        Edge(): next(nullptr) {}
-    };
+        if (!item.fill.getOuterRing().getVertices().isEmpty())
+            fillInnerArea(band, view, item.fill);
 
-    int areaHeight = this->size().height();
-    SimplePolygon outer = p.outerRing;
-    QList<SimplePolygon> inners = p.innerRings;
-    QVector<Edge*> NET(areaHeight + 1);
-    Edge *AET;
-
-    int ymaxAll = INT_MIN, yminAll = INT_MAX;
-    for (int i = 0; i < outer.vertices.size(); i++) {
-        if (outer.vertices[i].y > ymaxAll) {
-            ymaxAll = outer.vertices[i].y;
-        }
-        if (outer.vertices[i].y < yminAll) {
-            yminAll = outer.vertices[i].y;
-        }
+        // Paint edges
+        paintEdges(painter, item.outline.getOuterRing(), band.yBegin, band.yEnd);
+        for (int j = 0; j < item.outline.getInnerRings().size(); j++)
+            paintEdges(painter, item.outline.getInnerRings()[j], band.yBegin, band.yEnd);
     }
-    for (int i = 0; i <= ymaxAll; i++)
-        NET[i] = new Edge;
-    AET = new Edge;
-
-    // Add edges to NET
-    auto addNET = [&](SimplePolygon sp) {
-        int n = sp.vertices.size();
-        for (int i = 0; i < n; i++) {
-            Point p_prev_A = sp.vertices[(i-1+n)%n];
-            Point p_A = sp.vertices[i];
-            Point p_B = sp.vertices[(i+1)%n];
-            Point p_next_B = sp.vertices[(i+2)%n];
-
-            // Ignore horizontal lines
-            if (p_A.y == p_B.y)
-                continue;
-
-            int ymin = qMin(p_A.y, p_B.y);
-            int ymax = qMax(p_A.y, p_B.y);
-            double x = p_A.y < p_B.y ? p_A.x : p_B.x;
-            double deltax = 1.0 * (p_A.x - p_B.x) / (p_A.y - p_B.y);
-
-            // Deal with vertices like this:
-            //     ..      ..
-            //   ..    or    ..
-            //     ..      ..
-            if ((p_A.y == ymin && p_prev_A.y < ymin) ||
-                (p_B.y == ymin && p_next_B.y < ymin)) {
-                ymin++;
-                x += deltax;
-            }
-
-            // Insert into NET
-            Edge *p = new Edge;
-            p->x = x;
-            p->deltax = deltax;
-            p->ymax = ymax;
-            p->next = NET[ymin]->next;
-            NET[ymin]->next = p;
-        }
-    };
-
-    addNET(outer);
-    for (int i = 0; i < inners.size(); i++)
-        addNET(inners[i]);
-
-    // Start sweeping using AET
-    for (int y = yminAll; y < ymaxAll; y++) {
-
-        // Insert NET into AET
-        while(NET[y]->next) {
-            Edge *e = NET[y]->next;
-            Edge *insertPos = AET;
-
-            while (insertPos->next) {
-                // First compare x, second compare deltax.
-                if ((e->x > insertPos->next->x) ||
-                    (qAbs(e->x - insertPos->next->x) < 1e-5 && e->deltax > insertPos->next->deltax)) {
-                    insertPos = insertPos->next;
-                    continue;
-                }
-                break;
-            }
-
-            NET[y]->next = e->next;
-            e->next = insertPos->next;
-            insertPos->next = e;
-        }
-
-        // Fill color
-        Edge *p = AET;
-        while (p->next && p->next) {
-            double xA = p->next->x;
-            double xB = p->next->next->x;
-            painter.drawLine(static_cast<int>(xA + 1), y, static_cast<int>(xB - 1), y);
+}
 
-            p = p->next->next;
-        }
+// Only edges reaching rows yBegin <= y < yEnd, or the 2 pixels the pen
+// reaches past them, are stroked. They are stroked whole and clipped by the
+// band, so every band draws the same pixels as a single band would.
+void RenderArea::paintEdges(QPainter &painter, const SimplePolygon &sp, int yBegin, int yEnd) {
+    QPen pen(sp.edgeColor, 2, Qt::SolidLine);
+    painter.setPen(pen);
+    const QVector<Point> &vertices = sp.getVertices();
+    int v = vertices.size();
+    for (int i = 0; i < v; i++) {
+        Point v1 = vertices[i];
+        Point v2 = vertices[(i + 1) % v];
+        if (qMax(v1.y, v2.y) < yBegin - 2 || qMin(v1.y, v2.y) > yEnd + 2)
+            continue;
+        painter.drawLine(v1.x, v1.y, v2.x, v2.y);
+    }
 
-        // Delete invalid edges
-        p = AET;
-        while (p->next) {
-            if (p->next->ymax <= y) {
-                Edge *q = p->next;
-                p->next = q->next;
-                q->next = nullptr;
-                delete q;
-            }
-            else {
-                p = p->next;
-            }
-        }
+}
 
-        // Add up x
-        p = AET;
-        while (p->next) {
-            p->next->x += p->next->deltax;
-            p = p->next;
-        }
-    }
+void RenderArea::fillInnerArea(Band &band, QImage &view, const Polygon &p) {
+    // Using Line Sweep Algorithm, the spans are blended straight into the band
+    const QVector<ScanlineRasterizer::Span> &spans = band.rasterizer.rasterize(p, band.yBegin, band.yEnd);
+    ScanlineRasterizer::fillSpans(view, spans, p.fillColor, band.yBegin);
 }
@@ -2,7 +2,12 @@
 #define RENDERAREA_H
 
 #include "polygon.h"
+#include "scanline.h"
 #include <QWidget>
+#include <QImage>
+#include <QPainter>
+#include <QTimer>
+#include <QElapsedTimer>
 
 enum {
     DEFAULT,
@@ -39,6 +44,8 @@ public slots:
     void horizontallyFlip();
     void verticallyFlip();
     void clip(int id1, int id2);
+    // Draw the dragged layer without filling until the mouse is released
+    void setDragOutlineOnly(bool on);
 
 protected:
     void mousePressEvent(QMouseEvent *event) override;
@@ -49,8 +56,7 @@ protected:
 
 private:
     QList<Polygon> polygons;
-    QList<Point> tempPolygonPath;
-    Polygon tempPolygon;
+    QVector<Point> tempPolygonPath;
 
     int curGraphLayer = -1;
     int curStatus = DEFAULT;
@@ -60,12 +66,65 @@ private:
 
     bool startMove = false;
     bool startRotate = false;
+
+    // Mouse moves during a drag are coalesced, the layer is transformed at
+    // most once per display refresh. The transformation and centre are
+    // taken when the mouse is pressed.
+    QGenericMatrix<3, 3, double> pressTransformation;
+    Point dragCenter;
+    QTimer dragTimer;
+    QElapsedTimer lastDragStep;
+    int dragInterval = 16;
+    bool dragOutlineOnly = false;
+
+    // Layer the inner ring being drawn goes into, prepared at its first vertex
+    PreparedPolygon innerRingHost;
+    // Layers are composed into this image, which is blitted once per paintEvent
+    QImage canvas;
+
+    // Rasters of the layers below the current one (over the background),
+    // of the current layer and of the layers above it. Only dirty ones are
+    // rasterized again, so a drag repaints a single layer.
+    QImage belowCache;
+    QImage activeCache;
+    QImage aboveCache;
+    bool belowDirty = true;
+    bool activeDirty = true;
+    bool aboveDirty = true;
+    bool activePainted = false;
+    bool abovePainted = false;
+
+    // Rows yBegin <= y < yEnd of a raster, painted by one worker thread.
+    // The rasterizer is kept between paints so filling reuses its tables.
+    struct Band {
+        int yBegin;
+        int yEnd;
+        ScanlineRasterizer rasterizer;
+    };
+    QVector<Band> bands;
+
+    // A visible layer after transformation, shared read-only by the bands
+    struct PaintItem {
+        Polygon outline;
+        Polygon fill;   // Part inside the window, no rings if nothing to fill
+        int ymin;
+        int ymax;
+    };
+    QVector<PaintItem> paintItems;
+
 private:
+    void markLayerDirty(int id);
+    void markAllLayersDirty();
+    void splitBands();
+    void startDrag();
+    void applyDrag();
     void paintFrame();
-    void paintPolygon(Polygon p);
+    bool paintLayers(QImage &target, int first, int last, bool outlineOnly = false);
+    void preparePolygon(const Polygon &p, bool outlineOnly);
+    void paintBand(Band &band, uchar *bits, int bytesPerLine);
     void paintTempPolygonPath();
-    void paintEdges(SimplePolygon sp);
-    void fillInnerArea(Polygon p);
+    void paintEdges(QPainter &painter, const SimplePolygon &sp, int yBegin, int yEnd);
+    void fillInnerArea(Band &band, QImage &view, const Polygon &p);
 };
 
 #endif // RENDERAREA_H
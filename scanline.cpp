@@ -0,0 +1,189 @@
+#include "scanline.h"
+#include <QtMath>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// x / 255 rounded, exact for x <= 255 * 255
+inline quint32 div255(quint32 x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// dst = src + dst * (1 - alpha(src)) on n premultiplied pixels
+void blendSpan(QRgb *dst, int n, QRgb src) {
+    quint32 alpha = qAlpha(src);
+    if (alpha == 255) {
+        std::fill(dst, dst + n, src);
+        return;
+    }
+
+    quint32 inv = 255 - alpha;
+    int i = 0;
+#ifdef __SSE2__
+    // Four pixels at a time, each channel widened to 16 bits
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i factor = _mm_set1_epi16(static_cast<short>(inv));
+    const __m128i color = _mm_set1_epi32(static_cast<int>(src));
+    for (; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), factor), round);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), factor), round);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_adds_epu8(_mm_packus_epi16(lo, hi), color));
+    }
+#endif
+    for (; i < n; i++) {
+        quint32 d = dst[i];
+        quint32 out = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            quint32 c = ((src >> shift) & 0xff) + div255(((d >> shift) & 0xff) * inv);
+            out |= qMin(c, 255u) << shift;
+        }
+        dst[i] = out;
+    }
+}
+
+void ScanlineRasterizer::addEdges(const SimplePolygon &sp) {
+    int n = sp.getVertices().size();
+    for (int i = 0; i < n; i++) {
+        const Point &p_prev_A = sp.getVertices()[(i - 1 + n) % n];
+        const Point &p_A = sp.getVertices()[i];
+        const Point &p_B = sp.getVertices()[(i + 1) % n];
+        const Point &p_next_B = sp.getVertices()[(i + 2) % n];
+
+        // Ignore horizontal lines
+        if (p_A.y == p_B.y)
+            continue;
+
+        Edge e;
+        e.y0 = qMin(p_A.y, p_B.y);
+        e.ymax = qMax(p_A.y, p_B.y);
+        e.x0 = p_A.y < p_B.y ? p_A.x : p_B.x;
+        e.deltax = 1.0 * (p_A.x - p_B.x) / (p_A.y - p_B.y);
+
+        // Deal with vertices like this:
+        //     ..      ..
+        //   ..    or    ..
+        //     ..      ..
+        if ((p_A.y == e.y0 && p_prev_A.y < e.y0) ||
+            (p_B.y == e.y0 && p_next_B.y < e.y0)) {
+            e.y0++;
+            e.x0 += e.deltax;
+        }
+        edges.append(e);
+    }
+}
+
+const QVector<ScanlineRasterizer::Span> &ScanlineRasterizer::rasterize(const Polygon &p, int yBegin, int yEnd) {
+    edges.clear();
+    spans.clear();
+    addEdges(p.getOuterRing());
+    for (int i = 0; i < p.getInnerRings().size(); i++)
+        addEdges(p.getInnerRings()[i]);
+
+    // Rows to sweep, the last vertex row is not filled
+    int yFirst = INT_MAX, yLast = INT_MIN;
+    for (int i = 0; i < edges.size(); i++) {
+        yFirst = qMin(yFirst, edges[i].y0);
+        yLast = qMax(yLast, edges[i].ymax);
+    }
+    yFirst = qMax(yFirst, yBegin);
+    yLast = qMin(yLast, yEnd);
+    if (yFirst >= yLast)
+        return spans;
+
+    // Bucket the edges by their first row in the sweep. The table is sized by
+    // the rows swept, not by the window.
+    int rows = yLast - yFirst;
+    rowStart.fill(0, rows + 1);
+    for (int i = 0; i < edges.size(); i++) {
+        const Edge &e = edges[i];
+        if (e.ymax >= yFirst && e.y0 < yLast)
+            rowStart[qMax(e.y0, yFirst) - yFirst + 1]++;
+    }
+    for (int r = 0; r < rows; r++)
+        rowStart[r + 1] += rowStart[r];
+    order.resize(rowStart[rows]);
+    for (int i = 0; i < edges.size(); i++) {
+        const Edge &e = edges[i];
+        if (e.ymax >= yFirst && e.y0 < yLast)
+            order[rowStart[qMax(e.y0, yFirst) - yFirst]++] = i;
+    }
+    // The placement loop moved every start to the next bucket's
+    for (int r = rows; r > 0; r--)
+        rowStart[r] = rowStart[r - 1];
+    rowStart[0] = 0;
+
+    active.clear();
+    for (int y = yFirst; y < yLast; y++) {
+        int r = y - yFirst;
+        for (int k = rowStart[r]; k < rowStart[r + 1]; k++)
+            active.append(order[k]);
+
+        // Drop finished edges and move the rest to this row. x is evaluated
+        // from the start of the edge, so a band gets the same x as a full sweep.
+        int m = 0;
+        for (int k = 0; k < active.size(); k++) {
+            Edge &e = edges[active[k]];
+            if (e.ymax < y)
+                continue;
+            e.x = e.x0 + (y - e.y0) * e.deltax;
+            active[m++] = active[k];
+        }
+        active.resize(m);
+
+        // Insertion sort, the order barely changes between rows. Ties in x
+        // are broken by deltax.
+        for (int k = 1; k < m; k++) {
+            int cur = active[k];
+            const Edge &e = edges[cur];
+            int j = k;
+            while (j > 0) {
+                const Edge &q = edges[active[j - 1]];
+                bool after = qAbs(e.x - q.x) < 1e-5 ? q.deltax > e.deltax : q.x > e.x;
+                if (!after)
+                    break;
+                active[j] = active[j - 1];
+                j--;
+            }
+            active[j] = cur;
+        }
+
+        // Fill between pairs of edges. Slivers narrower than a pixel are left
+        // to the edge pen.
+        for (int k = 0; k + 1 < m; k += 2) {
+            Span s;
+            s.y = y;
+            s.xLeft = static_cast<int>(edges[active[k]].x + 1);
+            s.xRight = static_cast<int>(edges[active[k + 1]].x - 1);
+            if (s.xLeft <= s.xRight)
+                spans.append(s);
+        }
+    }
+
+    return spans;
+}
+
+void ScanlineRasterizer::fillSpans(QImage &image, const QVector<Span> &spans, const QColor &color, int yOrigin) {
+    QRgb src = qPremultiply(color.rgba());
+    if (qAlpha(src) == 0)
+        return;
+
+    int width = image.width(), height = image.height();
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+    for (int i = 0; i < spans.size(); i++) {
+        const Span &s = spans[i];
+        int y = s.y - yOrigin;
+        int xLeft = qMax(s.xLeft, 0), xRight = qMin(s.xRight, width - 1);
+        if (y < 0 || y >= height || xLeft > xRight)
+            continue;
+        QRgb *row = reinterpret_cast<QRgb *>(bits + y * bytesPerLine);
+        blendSpan(row + xLeft, xRight - xLeft + 1, src);
+    }
+}
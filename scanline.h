@@ -0,0 +1,49 @@
+#ifndef SCANLINE_H
+#define SCANLINE_H
+
+#include "polygon.h"
+#include <QVector>
+#include <QImage>
+#include <QColor>
+#include <climits>
+
+// Even-odd scanline fill with an edge table. The tables are kept between
+// calls and only grow, so a warmed-up rasterizer does not allocate.
+class ScanlineRasterizer {
+public:
+    // Pixels xLeft..xRight of row y, both inclusive
+    struct Span {
+        int y;
+        int xLeft;
+        int xRight;
+    };
+
+private:
+    struct Edge {
+        double x0;      // x at row y0
+        double deltax;
+        int y0;
+        int ymax;       // Last row the edge is active on
+        double x;       // x at the current row
+    };
+
+    QVector<Edge> edges;
+    QVector<int> rowStart;  // Edges starting at row r are order[rowStart[r] .. rowStart[r + 1])
+    QVector<int> order;
+    QVector<int> active;    // Active edge table, sorted by x
+    QVector<Span> spans;
+
+    void addEdges(const SimplePolygon &sp);
+
+public:
+    // Spans of p on rows yBegin <= y < yEnd. They stay valid until the next call.
+    const QVector<Span> &rasterize(const Polygon &p, int yBegin = INT_MIN, int yEnd = INT_MAX);
+
+    // Blend color over the spans of a Format_ARGB32_Premultiplied image whose
+    // top row is row yOrigin of the spans. Parts outside the image are skipped.
+    static void fillSpans(QImage &image, const QVector<Span> &spans, const QColor &color, int yOrigin = 0);
+};
+
+Q_DECLARE_TYPEINFO(ScanlineRasterizer::Span, Q_PRIMITIVE_TYPE);
+
+#endif // SCANLINE_H